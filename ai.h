@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include "game.h"
+
+// Computer controlled team. Every decision is a handful of closed form
+// computations on the current Match, so it costs the same no matter how far
+// away the ball is or how many wall bounces lie ahead.
+
+// Decisions use Scalar arithmetic like the rules, so bots stay in lockstep
+// in a fixed point build too.
+struct AiParams
+{
+	Scalar deadZone = 4.0f;     // px the paddle may sit off its target before it moves
+	Scalar aim = 0.0f;          // where the ball should meet the paddle: -1 top third, 0 middle, 1 bottom third
+	Scalar switchMargin = 0.0f; // ms of spare time demanded before handing over to the other paddle
+	Scalar error = 0.0f;        // px of misjudgement added to each predicted intercept
+};
+
+struct AiDecision
+{
+	bool up;
+	bool down;
+	int select; // the team's paddle to switch to, or -1 to keep the current one
+};
+
+struct Intercept
+{
+	Scalar time; // ms until the ball reaches the column, negative if it never will
+	Scalar y;    // ball top at that moment
+};
+
+// Map an unbounded y onto [0, span] the way bouncing between two walls does.
+inline Scalar FoldIntoField(Scalar y, Scalar span)
+{
+	Scalar period = span * 2;
+	Scalar m = y - period * static_cast<int>(y / period);
+	if (m < 0)
+	{
+		m += period;
+	}
+
+	return (m <= span) ? m : period - m;
+}
+
+// Where the ball crosses the front face of a paddle standing at paddleX.
+// CollideWithWall snaps the ball back onto the wall instead of mirroring the
+// overshoot, so the folded answer can be off by at most one frame of travel
+// per bounce.
+inline Intercept PredictIntercept(Transform const &ball, Velocity const &velocity, Scalar paddleX, Team team)
+{
+	Intercept intercept{-1, ball.y};
+
+	Scalar faceX = (team == Team::One) ? paddleX + PADDLE_WIDTH : paddleX - BALL_WIDTH;
+	if (velocity.x == 0)
+	{
+		return intercept;
+	}
+
+	Scalar time = (faceX - ball.x) / velocity.x;
+	if (time < 0)
+	{
+		return intercept;
+	}
+
+	intercept.time = time;
+	intercept.y = FoldIntoField(ball.y + velocity.y * time, HEIGHT - BALL_HEIGHT);
+
+	return intercept;
+}
+
+// Paddle top that puts the ball on the requested third of the paddle.
+inline Scalar AimPaddleAt(Scalar ballTop, Scalar aim, Rules const &rules)
+{
+	Scalar top = ballTop + BALL_HEIGHT - (rules.paddleHeight / 2) - aim * (rules.paddleHeight / 3);
+
+	if (top < 0)
+	{
+		return 0;
+	}
+	if (top > HEIGHT - rules.paddleHeight)
+	{
+		return HEIGHT - rules.paddleHeight;
+	}
+
+	return top;
+}
+
+// Misjudgement in [-1, 1]. Derived from the prediction itself rather than a
+// random generator, so the same situation always gets the same mistake and
+// the bot needs no state of its own. Where and when the ball will arrive both
+// stay put for a whole flight, so the target does not jitter frame to frame.
+inline Scalar Misjudge(Scalar predictedY, float arrival)
+{
+	uint32_t h = static_cast<uint32_t>(static_cast<int32_t>(predictedY / 8)) * 0x9e3779b9U;
+	h ^= static_cast<uint32_t>(static_cast<int32_t>(arrival / 64.0f));
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	h *= 0x846ca68bU;
+	h ^= h >> 16;
+
+	return Scalar(static_cast<int>(h & 0x7FFF)) / 16384 - 1;
+}
+
+inline AiDecision DecideAi(Match const &match, Team team, AiParams const &params)
+{
+	AiDecision decision{false, false, -1};
+
+	Transform const &ball = match.balls.Get<Transform>(0);
+	Velocity const &ballVelocity = match.balls.Get<Velocity>(0);
+	Transform const *paddleAt = match.paddles.Get<Transform>();
+	Velocity const *paddleVelocity = match.paddles.Get<Velocity>();
+	int first = match.FirstPaddle(team);
+	int teamSize = match.TeamSize();
+	int current = match.Current(team);
+	bool incoming = (team == Team::One) ? (ballVelocity.x < 0) : (ballVelocity.x > 0);
+
+	int chosen = current;
+	Rules const &rules = match.rules;
+	Scalar target = (HEIGHT / 2.0f) - (rules.paddleHeight / 2);
+
+	if (incoming)
+	{
+		// The ball meets the paddles furthest from our goal first, so prefer
+		// those whenever they can get there in time. Otherwise take whichever
+		// paddle is least late.
+		Scalar goalX = (team == Team::One) ? Scalar(0) : Scalar(WIDTH);
+		int order[MAX_TEAM_SIZE];
+		for (int k = 0; k < teamSize; ++k)
+		{
+			int slot = first + k;
+			int at = k;
+			for (; at > 0 && Abs(paddleAt[order[at - 1]].x - goalX) < Abs(paddleAt[slot].x - goalX); --at)
+			{
+				order[at] = order[at - 1];
+			}
+			order[at] = slot;
+		}
+
+		Scalar bestSlack = 0;
+		bool found = false;
+
+		for (int k = 0; k < teamSize; ++k)
+		{
+			int slot = order[k];
+			Intercept intercept = PredictIntercept(ball, ballVelocity, paddleAt[slot].x, team);
+			if (intercept.time < 0)
+			{
+				continue;
+			}
+
+			float arrival = match.totalTime + static_cast<float>(intercept.time);
+			Scalar guess = intercept.y + params.error * Misjudge(intercept.y, arrival);
+			Scalar goal = AimPaddleAt(guess, params.aim, rules);
+			Scalar slack = intercept.time - Abs(goal - paddleAt[slot].y) / rules.paddleSpeed;
+			if (slot != current)
+			{
+				slack -= params.switchMargin;
+			}
+
+			if (slack >= 0)
+			{
+				chosen = slot;
+				target = goal;
+				found = true;
+				break;
+			}
+
+			if (!found || slack > bestSlack)
+			{
+				bestSlack = slack;
+				chosen = slot;
+				target = goal;
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			// Ball is already behind all our paddles, keep chasing it
+			target = AimPaddleAt(ball.y, params.aim, rules);
+		}
+	}
+
+	if (chosen != current)
+	{
+		// A paddle we switch away from keeps its velocity, so park it first
+		if (paddleVelocity[current].y == 0)
+		{
+			decision.select = chosen - first;
+		}
+		return decision;
+	}
+
+	Scalar offset = target - paddleAt[current].y;
+	decision.up = offset < -params.deadZone;
+	decision.down = offset > params.deadZone;
+
+	return decision;
+}
+
+// The decision as one tick of packed input, for Match::Tick
+inline uint8_t AiInput(AiDecision const &decision)
+{
+	return static_cast<uint8_t>((decision.up ? InputUp : 0) | (decision.down ? InputDown : 0) |
+								(decision.select >= 0 ? InputSelect(decision.select) : 0));
+}
+
+// Feed a decision into the same inputs a human player would use.
+inline void ApplyAi(Match &match, Team team, AiDecision const &decision, bool buttons[4])
+{
+	int up = (team == Team::One) ? Buttons::PaddleOneUp : Buttons::PaddleTwoUp;
+	int down = (team == Team::One) ? Buttons::PaddleOneDown : Buttons::PaddleTwoDown;
+
+	buttons[up] = decision.up;
+	buttons[down] = decision.down;
+
+	if (decision.select >= 0)
+	{
+		match.Select(team, decision.select);
+	}
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator for data that lives for one frame or one tick: HUD text,
+// contact lists, draw commands. Allocating is a pointer increment and
+// Reset() frees everything at once. A frame that needs more than the block
+// holds spills into extra blocks; the next Reset() replaces them with one
+// block big enough for that frame, so after the first busy frames a steady
+// game does no heap traffic at all.
+//
+// Not thread safe. Each thread uses its own arena (FrameArenas).
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity = 64 * 1024)
+	{
+		Grow(capacity);
+	}
+
+	FrameArena(FrameArena const &) = delete;
+	FrameArena &operator=(FrameArena const &) = delete;
+
+	// Never returns null; align must be a power of two
+	void *Allocate(size_t size, size_t align = alignof(std::max_align_t))
+	{
+		uintptr_t at = (reinterpret_cast<uintptr_t>(block.get()) + used + align - 1) & ~(align - 1);
+		size_t end = at - reinterpret_cast<uintptr_t>(block.get()) + size;
+		if (end > capacity)
+		{
+			return Spill(size, align);
+		}
+
+		used = end;
+		Touch();
+		return reinterpret_cast<void *>(at);
+	}
+
+	// Uninitialised storage for count Ts; T must not need destroying
+	template <typename T>
+	T *AllocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "the arena never runs destructors");
+		return static_cast<T *>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	// printf into the arena. Prints straight into the free space and only
+	// measures first when the text does not fit there.
+	char const *Format(char const *format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		va_list again;
+		va_copy(again, args);
+
+		char *text = reinterpret_cast<char *>(block.get()) + used;
+		int length = std::vsnprintf(text, capacity - used, format, args);
+		va_end(args);
+		if (length >= 0 && static_cast<size_t>(length) < capacity - used)
+		{
+			used += length + 1;
+			Touch();
+		}
+		else
+		{
+			size_t size = length < 0 ? 1 : length + 1;
+			text = static_cast<char *>(Allocate(size, 1));
+			text[0] = '\0';
+			std::vsnprintf(text, size, format, again);
+		}
+		va_end(again);
+		return text;
+	}
+
+	// Forget everything allocated since the last Reset
+	void Reset()
+	{
+		if (!spills.empty())
+		{
+			// Next time the whole frame fits in one block
+			size_t needed = frameBytes;
+			spills.clear();
+			spillBytes = 0;
+			Grow(needed > capacity * 2 ? needed : capacity * 2);
+		}
+		used = 0;
+		frameBytes = 0;
+	}
+
+	size_t Used() const { return frameBytes; }
+	size_t Capacity() const { return capacity; }
+
+	// Most bytes any frame has used
+	size_t HighWater() const { return highWater; }
+
+	// Heap allocations made since the arena was created; stays put once
+	// frames are steady
+	int Growths() const { return growths; }
+
+private:
+	void Grow(size_t size)
+	{
+		block.reset(new uint8_t[size]);
+		capacity = size;
+		++growths;
+	}
+
+	void *Spill(size_t size, size_t align)
+	{
+		spills.emplace_back(new uint8_t[size + align]);
+		++growths;
+		uintptr_t at = (reinterpret_cast<uintptr_t>(spills.back().get()) + align - 1) & ~(align - 1);
+		spillBytes += size + align;
+		Touch();
+		return reinterpret_cast<void *>(at);
+	}
+
+	void Touch()
+	{
+		frameBytes = used + spillBytes;
+		highWater = frameBytes > highWater ? frameBytes : highWater;
+	}
+
+	std::unique_ptr<uint8_t[]> block;
+	size_t capacity = 0;
+	size_t used = 0;
+	std::vector<std::unique_ptr<uint8_t[]>> spills;
+	size_t spillBytes = 0;
+	size_t frameBytes = 0;
+	size_t highWater = 0;
+	int growths = 0;
+};
+
+// One arena per worker, indexed like WorkerPool::Run. Reset them all between
+// frames while the workers are idle.
+class FrameArenas
+{
+public:
+	explicit FrameArenas(int workers, size_t capacity = 64 * 1024)
+	{
+		for (int i = 0; i < workers; ++i)
+		{
+			arenas.emplace_back(new FrameArena(capacity));
+		}
+	}
+
+	FrameArena &operator[](int worker) { return *arenas[worker]; }
+	int Count() const { return static_cast<int>(arenas.size()); }
+
+	void ResetAll()
+	{
+		for (auto &arena : arenas)
+		{
+			arena->Reset();
+		}
+	}
+
+	// Largest single-arena high-water mark
+	size_t HighWater() const
+	{
+		size_t most = 0;
+		for (auto const &arena : arenas)
+		{
+			most = arena->HighWater() > most ? arena->HighWater() : most;
+		}
+		return most;
+	}
+
+private:
+	std::vector<std::unique_ptr<FrameArena>> arenas;
+};
+
+// Lets standard containers take their storage from an arena for one frame.
+// Deallocation is a no-op; the memory comes back at Reset.
+template <typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+
+	template <typename U>
+	ArenaAllocator(ArenaAllocator<U> const &other) : arena(other.arena) {}
+
+	T *allocate(size_t count)
+	{
+		return static_cast<T *>(arena->Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	void deallocate(T *, size_t)
+	{
+	}
+
+	template <typename U>
+	bool operator==(ArenaAllocator<U> const &other) const { return arena == other.arena; }
+	template <typename U>
+	bool operator!=(ArenaAllocator<U> const &other) const { return arena != other.arena; }
+
+	FrameArena *arena;
+};
+
+// A vector that lives for one frame
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
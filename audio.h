@@ -0,0 +1,331 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "game.h"
+
+// Sound effects. Every effect is PCM in memory before the first frame; the
+// audio device's callback mixes whatever is playing into its buffer. The
+// game never touches a voice: it posts play commands through a single
+// producer, single consumer queue that the callback drains, so a collision
+// costs two stores and never waits on the audio thread. Nothing here depends
+// on SDL (main.cpp opens the device).
+
+const int AUDIO_RATE = 48000;
+const int AUDIO_FRAMES = 256; // per callback: 5.3 ms at 48 kHz
+const int MAX_VOICES = 64;
+const int SOUND_QUEUE_SIZE = 256;
+
+enum class Sound : uint8_t
+{
+	Kick,    // paddle hit
+	Bounce,  // wall
+	Goal,
+	Whistle, // kickoff and full time
+	Count
+};
+
+// Wait-free ring for one producer thread and one consumer thread. Capacity
+// must be a power of two.
+template <typename T, int Capacity>
+class SpscQueue
+{
+public:
+	static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+	// Producer. False when full; the item is not queued.
+	bool Push(T const &item)
+	{
+		uint32_t at = tail.load(std::memory_order_relaxed);
+		if (at - head.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+		items[at & (Capacity - 1)] = item;
+		tail.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer. False when empty.
+	bool Pop(T &item)
+	{
+		uint32_t at = head.load(std::memory_order_relaxed);
+		if (at == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		item = items[at & (Capacity - 1)];
+		head.store(at + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	alignas(64) std::atomic<uint32_t> head{0};
+	alignas(64) std::atomic<uint32_t> tail{0};
+	T items[Capacity];
+};
+
+struct PlayCommand
+{
+	Sound sound;
+	float gain;
+	float pan; // -1 left to +1 right
+};
+
+class Mixer
+{
+public:
+	Mixer()
+	{
+		Synthesize();
+	}
+
+	Mixer(Mixer const &) = delete;
+	Mixer &operator=(Mixer const &) = delete;
+
+	// Replace an effect with mono PCM at AUDIO_RATE, such as a decoded WAV.
+	// Only while the device is not running.
+	void Load(Sound sound, std::vector<float> samples)
+	{
+		clips[static_cast<int>(sound)] = std::move(samples);
+		Pad(clips[static_cast<int>(sound)]);
+	}
+
+	// Game thread. Wait-free; when the queue is full the sound is dropped.
+	bool Play(Sound sound, float gain = 1.0f, float pan = 0.0f)
+	{
+		if (!commands.Push(PlayCommand{sound, gain, pan}))
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	// Audio thread. Writes frames of interleaved stereo floats.
+	void Mix(float *out, int frames)
+	{
+		PlayCommand command;
+		while (commands.Pop(command))
+		{
+			Start(command);
+		}
+
+		std::memset(out, 0, sizeof(float) * 2 * frames);
+		int active = 0;
+		for (Voice &voice : voices)
+		{
+			if (!voice.samples)
+			{
+				continue;
+			}
+			int count = voice.length - voice.position < frames ? voice.length - voice.position : frames;
+			MixVoice(out, voice.samples + voice.position, count, voice.left, voice.right);
+			voice.position += count;
+			if (voice.position >= voice.length)
+			{
+				voice.samples = nullptr;
+			}
+			else
+			{
+				++active;
+			}
+		}
+		Clip(out, 2 * frames);
+
+		playing.store(active, std::memory_order_relaxed);
+		mixed.fetch_add(frames, std::memory_order_relaxed);
+	}
+
+	// Readable from any thread
+	int Playing() const { return playing.load(std::memory_order_relaxed); }
+	long long Dropped() const { return dropped.load(std::memory_order_relaxed); }
+	long long Stolen() const { return stolen.load(std::memory_order_relaxed); }
+	long long FramesMixed() const { return mixed.load(std::memory_order_relaxed); }
+
+private:
+	struct Voice
+	{
+		float const *samples = nullptr; // null when free
+		int length = 0;
+		int position = 0;
+		float left = 0.0f, right = 0.0f;
+	};
+
+	void Start(PlayCommand const &command)
+	{
+		std::vector<float> const &clip = clips[static_cast<int>(command.sound)];
+		if (clip.empty())
+		{
+			return;
+		}
+
+		// A free voice, or else the one furthest through its sound
+		Voice *voice = &voices[0];
+		for (Voice &candidate : voices)
+		{
+			if (!candidate.samples)
+			{
+				voice = &candidate;
+				break;
+			}
+			voice = candidate.position > voice->position ? &candidate : voice;
+		}
+		if (voice->samples)
+		{
+			stolen.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Equal power pan
+		const float QUARTER_PI = 0.78539816f;
+		float pan = command.pan < -1.0f ? -1.0f : command.pan > 1.0f ? 1.0f : command.pan;
+		voice->samples = clip.data();
+		voice->length = static_cast<int>(clip.size());
+		voice->position = 0;
+		voice->left = command.gain * std::cos((pan + 1.0f) * QUARTER_PI);
+		voice->right = command.gain * std::sin((pan + 1.0f) * QUARTER_PI);
+	}
+
+	// out[2i] += in[i] * left, out[2i + 1] += in[i] * right
+	static void MixVoice(float *out, float const *in, int count, float left, float right)
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		__m128 gainLeft = _mm_set1_ps(left);
+		__m128 gainRight = _mm_set1_ps(right);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 mono = _mm_loadu_ps(in + i);
+			__m128 l = _mm_mul_ps(mono, gainLeft);
+			__m128 r = _mm_mul_ps(mono, gainRight);
+			float *at = out + 2 * i;
+			_mm_storeu_ps(at, _mm_add_ps(_mm_loadu_ps(at), _mm_unpacklo_ps(l, r)));
+			_mm_storeu_ps(at + 4, _mm_add_ps(_mm_loadu_ps(at + 4), _mm_unpackhi_ps(l, r)));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			out[2 * i] += in[i] * left;
+			out[2 * i + 1] += in[i] * right;
+		}
+	}
+
+	static void Clip(float *out, int count)
+	{
+		int i = 0;
+#if defined(__SSE2__)
+		__m128 low = _mm_set1_ps(-1.0f);
+		__m128 high = _mm_set1_ps(1.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(out + i), low), high));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			out[i] = out[i] < -1.0f ? -1.0f : out[i] > 1.0f ? 1.0f : out[i];
+		}
+	}
+
+	// Whole groups of four so the SIMD loop covers every clip
+	static void Pad(std::vector<float> &samples)
+	{
+		samples.resize((samples.size() + 3) / 4 * 4, 0.0f);
+	}
+
+	// The game ships no sound files, so the effects are made here
+	void Synthesize()
+	{
+		const float TAU = 6.2831853f;
+		uint32_t noise = 22222;
+		auto random = [&noise]()
+		{
+			noise ^= noise << 13;
+			noise ^= noise >> 17;
+			noise ^= noise << 5;
+			return (noise >> 8) * (2.0f / 16777216.0f) - 1.0f;
+		};
+		auto make = [](float seconds) { return std::vector<float>(static_cast<size_t>(seconds * AUDIO_RATE)); };
+
+		// Kick: a thump falling from 160 Hz to 50 Hz
+		std::vector<float> kick = make(0.12f);
+		float phase = 0.0f;
+		for (size_t i = 0; i < kick.size(); ++i)
+		{
+			float t = static_cast<float>(i) / AUDIO_RATE;
+			phase += TAU * (50.0f + 110.0f * std::exp(-t * 40.0f)) / AUDIO_RATE;
+			kick[i] = 0.9f * std::sin(phase) * std::exp(-t * 30.0f);
+		}
+
+		// Bounce: a short knock
+		std::vector<float> bounce = make(0.05f);
+		for (size_t i = 0; i < bounce.size(); ++i)
+		{
+			float t = static_cast<float>(i) / AUDIO_RATE;
+			bounce[i] = (0.5f * std::sin(TAU * 700.0f * t) + 0.2f * random()) * std::exp(-t * 90.0f);
+		}
+
+		// Goal: a crowd-like swell of filtered noise under a rising chord
+		std::vector<float> goal = make(1.6f);
+		float smooth = 0.0f;
+		for (size_t i = 0; i < goal.size(); ++i)
+		{
+			float t = static_cast<float>(i) / AUDIO_RATE;
+			float envelope = (t < 0.25f ? t / 0.25f : 1.0f) * std::exp(-(t > 0.25f ? t - 0.25f : 0.0f) * 2.0f);
+			smooth += 0.08f * (random() - smooth);
+			float chord = std::sin(TAU * 440.0f * t) + std::sin(TAU * 554.4f * t) + std::sin(TAU * 659.3f * t);
+			goal[i] = envelope * (1.6f * smooth + 0.12f * chord * (t < 0.6f ? 1.0f : 0.0f));
+		}
+
+		// Whistle: a trilled 2.6 kHz tone
+		std::vector<float> whistle = make(0.7f);
+		phase = 0.0f;
+		for (size_t i = 0; i < whistle.size(); ++i)
+		{
+			float t = static_cast<float>(i) / AUDIO_RATE;
+			phase += TAU * (2600.0f + 120.0f * std::sin(TAU * 28.0f * t)) / AUDIO_RATE;
+			float envelope = (t < 0.02f ? t / 0.02f : 1.0f) * (t > 0.6f ? (0.7f - t) / 0.1f : 1.0f);
+			whistle[i] = 0.35f * envelope * std::sin(phase);
+		}
+
+		Load(Sound::Kick, kick);
+		Load(Sound::Bounce, bounce);
+		Load(Sound::Goal, goal);
+		Load(Sound::Whistle, whistle);
+	}
+
+	std::vector<float> clips[static_cast<int>(Sound::Count)];
+	Voice voices[MAX_VOICES];
+	SpscQueue<PlayCommand, SOUND_QUEUE_SIZE> commands;
+	std::atomic<int> playing{0};
+	std::atomic<long long> dropped{0};
+	std::atomic<long long> stolen{0};
+	std::atomic<long long> mixed{0};
+};
+
+// The sound for something the ball did, panned to where it happened.
+// ball is where it was before the tick, as for EventBurst.
+inline void PlayEvent(Mixer &mixer, MatchEvent event, Transform const &ball)
+{
+	float pan = (static_cast<float>(ball.x) + BALL_WIDTH / 2.0f) / WIDTH * 2.0f - 1.0f;
+	if (event == MatchEvent::PaddleHit)
+	{
+		mixer.Play(Sound::Kick, 0.8f, pan);
+	}
+	else if (event == MatchEvent::WallBounce)
+	{
+		mixer.Play(Sound::Bounce, 0.5f, pan);
+	}
+	else if (event == MatchEvent::GoalOne || event == MatchEvent::GoalTwo)
+	{
+		mixer.Play(Sound::Goal, 0.9f, event == MatchEvent::GoalOne ? 0.6f : -0.6f);
+	}
+}
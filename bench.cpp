@@ -0,0 +1,884 @@
+// Benchmarks for the headless code paths.
+//
+//   bench            run everything
+//   bench vecenv     run the benchmarks whose name starts with "vecenv"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "ai.h"
+#include "arena.h"
+#include "audio.h"
+#include "botlink.h"
+#include "particles.h"
+#include "raster.h"
+#include "replay.h"
+#include "snapshot.h"
+#include "spectator.h"
+#include "tiles.h"
+#include "vecenv.h"
+
+// Keeps the optimiser from throwing away work whose result is never read
+static volatile float sink;
+
+// Every allocation made with new anywhere in the process, so a benchmark
+// can show it made none
+static std::atomic<long long> heapAllocations{0};
+
+static void *CountedAllocate(size_t size)
+{
+	++heapAllocations;
+	if (void *memory = std::malloc(size ? size : 1))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+// For over-aligned types, e.g. anything holding an alignas(64) member
+static void *CountedAllocate(size_t size, std::align_val_t align)
+{
+	++heapAllocations;
+	size_t alignment = static_cast<size_t>(align);
+	size_t rounded = (size + alignment - 1) / alignment * alignment; // aligned_alloc wants a multiple
+	if (void *memory = std::aligned_alloc(alignment, rounded ? rounded : alignment))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+// Every form is replaced so each new meets the delete that matches it
+void *operator new(size_t size)
+{
+	return CountedAllocate(size);
+}
+
+void *operator new[](size_t size)
+{
+	return CountedAllocate(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+void *operator new(size_t size, std::align_val_t align)
+{
+	return CountedAllocate(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align)
+{
+	return CountedAllocate(size, align);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+// Call body(n) with growing n until it has run for about half a second and
+// return the time per unit of work in nanoseconds.
+template <typename Body>
+static double Measure(Body body)
+{
+	using Clock = std::chrono::steady_clock;
+	long long n = 1;
+	for (;;)
+	{
+		auto start = Clock::now();
+		body(n);
+		double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		if (ns > 5.0e8 || n > (1LL << 40))
+		{
+			return ns / n;
+		}
+		n *= 2;
+	}
+}
+
+static void Report(char const *name, double ns, char const *unit = "op")
+{
+	std::printf("%-28s %12.1f ns/%s %14.0f %s/s\n", name, ns, unit, 1.0e9 / ns, unit);
+}
+
+static void BenchMatchUpdate(int teamSize)
+{
+	Rules rules;
+	rules.teamSize = teamSize;
+	Match match(rules);
+	bool buttons[4] = {};
+	AiParams params;
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			ApplyAi(match, Team::One, DecideAi(match, Team::One, params), buttons);
+			ApplyAi(match, Team::Two, DecideAi(match, Team::Two, params), buttons);
+			match.ApplyButtons(buttons);
+			match.Update(TICK_MS);
+			if (match.finished)
+			{
+				match.Reset();
+			}
+		}
+		sink = static_cast<float>(match.balls.Get<Transform>(0).x);
+	});
+	char name[64];
+	std::snprintf(name, sizeof(name), "match/update+2ai/%d a side", teamSize);
+	Report(name, ns, "tick");
+}
+
+// Not a timing: a fixed bot match whose final checksum should be identical
+// for every build of the fixed point physics.
+static void ReportChecksum()
+{
+	Match match;
+	bool buttons[4] = {};
+	AiParams one, two;
+	one.error = 90.0f;
+	two.error = 60.0f;
+	for (int tick = 0; tick < 20000; ++tick)
+	{
+		ApplyAi(match, Team::One, DecideAi(match, Team::One, one), buttons);
+		ApplyAi(match, Team::Two, DecideAi(match, Team::Two, two), buttons);
+		match.ApplyButtons(buttons);
+		match.Update(TICK_MS);
+		if (match.finished)
+		{
+			match.Reset();
+		}
+	}
+
+#ifdef FIXED_POINT_PHYSICS
+	char const *physics = "fixed";
+#else
+	char const *physics = "float";
+#endif
+	std::printf("%-28s %08x (%s, %d-%d)\n", "match/checksum", match.Checksum(), physics,
+				match.playerOneScore, match.playerTwoScore);
+}
+
+static void BenchAiDecide()
+{
+	Match match;
+	AiParams params;
+	double ns = Measure([&](long long n)
+	{
+		int moves = 0;
+		for (long long i = 0; i < n; ++i)
+		{
+			match.balls.Get<Transform>(0).x = static_cast<float>(i & 511) + 100.0f;
+			AiDecision decision = DecideAi(match, Team::Two, params);
+			moves += decision.up + decision.down;
+		}
+		sink = static_cast<float>(moves);
+	});
+	Report("ai/decide", ns);
+}
+
+static void BenchVecEnv(int envs, int threads)
+{
+	VecEnv env(envs, threads);
+	std::vector<uint8_t> actions(envs);
+	for (int i = 0; i < envs; ++i)
+	{
+		actions[i] = static_cast<uint8_t>(i % 3);
+	}
+
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			env.Step(actions.data());
+		}
+		sink = env.Observations()[0];
+	});
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "vecenv/%d envs/%d threads", envs, threads);
+	Report(name, ns / envs, "step");
+}
+
+static void BenchRaster(int size, int channels)
+{
+	Rasterizer raster(size, size, channels);
+	std::vector<uint8_t> frame(raster.FrameBytes());
+	Match match;
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			match.balls.Get<Transform>(0).x = static_cast<float>(i & 1023);
+			raster.Draw(match, frame.data());
+		}
+		sink = frame[frame.size() / 2];
+	});
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "raster/%dx%d/%s", size, size, channels == 1 ? "gray" : "rgb");
+	Report(name, ns, "frame");
+}
+
+static void BenchVecEnvRender(int envs, int threads)
+{
+	VecEnv env(envs, threads);
+	Rasterizer raster;
+	std::vector<uint8_t> frames(static_cast<size_t>(envs) * raster.FrameBytes());
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			env.Render(raster, frames.data());
+		}
+		sink = frames[0];
+	});
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "vecenv/render %d envs/%d thr", envs, threads);
+	Report(name, ns / envs, "frame");
+}
+
+// Encode every tick of a bot match against the snapshot age ticks older (0 for
+// full snapshots), which is what a client acknowledging that far back costs.
+static void BenchSnapshot(int age)
+{
+	SnapshotCodec codec;
+	std::vector<Snapshot> snapshots;
+	Match match;
+	AiParams one, two;
+	one.error = 90.0f;
+	two.error = 60.0f;
+	for (uint32_t tick = 1; tick <= 8192; ++tick)
+	{
+		match.Tick(AiInput(DecideAi(match, Team::One, one)), AiInput(DecideAi(match, Team::Two, two)));
+		snapshots.push_back(codec.Capture(match, tick));
+	}
+
+	size_t count = snapshots.size() - age;
+	std::vector<uint8_t> encoded(count * MAX_SNAPSHOT_BYTES);
+	std::vector<int> sizes(count);
+	long long bytes = 0;
+	long long small = 0;
+
+	double encodeNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			size_t at = i % count;
+			Snapshot const *baseline = age ? &snapshots[at] : nullptr;
+			sizes[at] = codec.Encode(snapshots[at + age], baseline, &encoded[at * MAX_SNAPSHOT_BYTES], MAX_SNAPSHOT_BYTES);
+		}
+		sink = static_cast<float>(sizes[0]);
+	});
+
+	for (size_t at = 0; at < count; ++at)
+	{
+		bytes += sizes[at];
+		small += sizes[at] < 16;
+	}
+
+	// The decoder finds its baseline in a history, as a client would
+	SnapshotHistory history;
+	int wrong = 0;
+	double decodeNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			size_t at = i % count;
+			history.Clear();
+			if (age)
+			{
+				history.Add(snapshots[at]);
+			}
+			Snapshot decoded;
+			codec.Decode(&encoded[at * MAX_SNAPSHOT_BYTES], sizes[at], history, decoded);
+			wrong += decoded.tick != snapshots[at + age].tick ||
+					 std::memcmp(decoded.values, snapshots[at + age].values, sizeof(decoded.values)) != 0;
+		}
+		sink = static_cast<float>(wrong);
+	});
+
+	char kind[16];
+	std::snprintf(kind, sizeof(kind), age ? "age %d" : "full", age);
+	char name[64];
+	std::snprintf(name, sizeof(name), "snapshot/encode/%s", kind);
+	Report(name, encodeNs, "snap");
+	std::snprintf(name, sizeof(name), "snapshot/decode/%s", kind);
+	Report(name, decodeNs, "snap");
+	std::printf("%-28s %12.2f bytes avg, %.1f%% under 16 bytes%s\n", "", static_cast<double>(bytes) / count,
+				100.0 * small / count, wrong ? ", DECODE MISMATCH" : "");
+}
+
+// A sender and a receiver trading deltas every few ticks, the receiver
+// acknowledging each state it decodes. At 16 ticks a receive history spans
+// 512 ticks, so baselines whose ticks share a low byte sit side by side.
+static void CheckSnapshotStream(int every)
+{
+	SnapshotCodec codec;
+	SnapshotHistory sent, received;
+	Match match;
+	AiParams one, two;
+	uint32_t ack = 0;
+	int states = 0;
+	int wrong = 0;
+	uint8_t packet[MAX_SNAPSHOT_BYTES];
+	for (uint32_t tick = 1; tick <= 8192; ++tick)
+	{
+		match.Tick(AiInput(DecideAi(match, Team::One, one)), AiInput(DecideAi(match, Team::Two, two)));
+		if (tick % every != 0)
+		{
+			continue;
+		}
+
+		Snapshot snapshot = codec.Capture(match, tick);
+		sent.Add(snapshot);
+		int size = codec.Encode(snapshot, ack ? sent.Find(ack) : nullptr, packet, sizeof(packet));
+
+		Snapshot decoded;
+		bool ok = codec.Decode(packet, size, received, decoded) && decoded.tick == snapshot.tick &&
+				  std::memcmp(decoded.values, snapshot.values, sizeof(decoded.values)) == 0;
+		wrong += !ok;
+		++states;
+		if (ok)
+		{
+			received.Add(decoded);
+			ack = decoded.tick;
+		}
+	}
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "snapshot/stream/every %d", every);
+	std::printf("%-28s %12d states, %d wrong%s\n", name, states, wrong, wrong ? ", DECODE MISMATCH" : "");
+}
+
+// Record a 90 minute bot match, then jump to minute 80 through the keyframe
+// index and check it lands on exactly the state a full replay reaches.
+static void BenchReplaySeek()
+{
+	Rules rules;
+	rules.matchTime = 90.0f * 60.0f * 1000.0f;
+	char const *path = "bench_replay.tbr";
+
+	Match match(rules);
+	AiParams one, two;
+	one.error = 90.0f;
+	two.error = 60.0f;
+	ReplayWriter writer;
+	writer.Open(path, rules);
+	while (!match.finished)
+	{
+		uint8_t inputOne = AiInput(DecideAi(match, Team::One, one));
+		uint8_t inputTwo = AiInput(DecideAi(match, Team::Two, two));
+		writer.Record(match, inputOne, inputTwo);
+		match.Tick(inputOne, inputTwo);
+	}
+	writer.Close();
+
+	ReplayReader replay;
+	std::string error = replay.Open(path);
+	std::remove(path);
+	if (!error.empty())
+	{
+		std::printf("replay: %s\n", error.c_str());
+		return;
+	}
+
+	int target = static_cast<int>(80.0f * 60.0f * 1000.0f / TICK_MS) + 123;
+
+	// From tick 0, the way a replay without keyframes would have to
+	Match linear(rules);
+	auto start = std::chrono::steady_clock::now();
+	for (int tick = 0; tick < target; ++tick)
+	{
+		replay.Step(linear, tick);
+	}
+	double linearNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	uint32_t seekChecksum = 0;
+	double seekNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			seekChecksum = replay.Seek(target - static_cast<int>(i & 255)).Checksum();
+		}
+	});
+	seekChecksum = replay.Seek(target).Checksum();
+
+	Report("replay/seek to 80 min", seekNs, "seek");
+	Report("replay/play from tick 0", linearNs, "seek");
+	std::printf("%-28s %12s (%d ticks, keyframe every %d)\n", "",
+				seekChecksum == linear.Checksum() ? "identical" : "MISMATCH", replay.TickCount(), replay.Interval());
+}
+
+// What publishing to the spectator feed adds to every game tick, and what a
+// reader pays to copy the newest snapshot out
+static void BenchSpectator()
+{
+	SpectatorFeed feed;
+	SpectatorReader reader;
+	if (!feed.Open("/tinyball-bench") || !reader.Open("/tinyball-bench"))
+	{
+		std::printf("spectator: no shared memory\n");
+		return;
+	}
+
+	SnapshotCodec codec;
+	Match match;
+	uint32_t tick = 0;
+	double publishNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			match.balls.Get<Transform>(0).x = static_cast<float>(i & 511);
+			feed.Publish(codec.Capture(match, ++tick));
+		}
+	});
+
+	Snapshot snapshot;
+	double readNs = Measure([&](long long n)
+	{
+		int32_t sum = 0;
+		for (long long i = 0; i < n; ++i)
+		{
+			reader.Latest(snapshot);
+			sum += snapshot.values[FieldBallX];
+		}
+		sink = static_cast<float>(sum);
+	});
+
+	Report("spectator/capture+publish", publishNs, "tick");
+	Report("spectator/read latest", readNs, "read");
+}
+
+// A full decision round trip with the bot on another thread: observation
+// out, futex wake, AI decision, answer back
+static void BenchBotLink()
+{
+	BotLink link;
+	if (!link.Open(Team::Two, Rules(), "/tinyball-bench-bot"))
+	{
+		std::printf("botlink: no shared memory\n");
+		return;
+	}
+
+	std::atomic<bool> stop{false};
+	std::thread bot([&]()
+	{
+		BotClient client;
+		if (!client.Attach("/tinyball-bench-bot"))
+		{
+			return;
+		}
+		AiParams params;
+		while (!stop.load())
+		{
+			if (client.Wait(50.0f))
+			{
+				client.Answer(AiInput(DecideAi(client.State(), client.GetTeam(), params)));
+			}
+		}
+	});
+	while (!link.Attached())
+	{
+		std::this_thread::yield();
+	}
+
+	Match match;
+	uint32_t tick = 0;
+	double decideNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			sink = link.Decide(match, ++tick, 5.0f);
+			match.Tick(0, 0);
+		}
+	});
+	stop.store(true);
+	bot.join();
+
+	Report("botlink/round trip", decideNs, "tick");
+	std::printf("%-28s %12.1f us worst, %llu of %llu late\n", "", link.stats.maxRoundTripUs,
+				static_cast<unsigned long long>(link.stats.late), static_cast<unsigned long long>(link.stats.requests));
+}
+
+// A frame's worth of HUD text and a contact list, from the heap and from a
+// frame arena, plus one arena per worker doing the same on a pool
+static void BenchArena()
+{
+	Match match;
+	auto heapFrame = [&](int frame)
+	{
+		std::string score = std::to_string(match.playerOneScore) + " - " + std::to_string(match.playerTwoScore);
+		std::string timer = "Timer: " + std::to_string(frame * TICK_MS / 1000).substr(0, 4) + "s / 90s";
+		std::vector<Contact> contacts;
+		for (int i = 0; i < 64; ++i)
+		{
+			contacts.push_back({CollisionType::Middle, Scalar(i)});
+		}
+		sink = static_cast<float>(score.size() + timer.size() + contacts.size());
+	};
+
+	FrameArena arena(1024);
+	auto arenaFrame = [&](int frame)
+	{
+		char const *score = arena.Format("%d - %d", match.playerOneScore, match.playerTwoScore);
+		char const *seconds = arena.Format("%f", frame * TICK_MS / 1000);
+		char const *timer = arena.Format("Timer: %.4ss / 90s", seconds);
+		FrameVector<Contact> contacts{ArenaAllocator<Contact>(arena)};
+		for (int i = 0; i < 64; ++i)
+		{
+			contacts.push_back({CollisionType::Middle, Scalar(i)});
+		}
+		sink = static_cast<float>(std::strlen(score) + std::strlen(timer) + contacts.size());
+		arena.Reset();
+	};
+
+	long long before = heapAllocations.load();
+	long long frames = 0;
+	double heapNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			heapFrame(static_cast<int>(i));
+		}
+		frames += n;
+	});
+	double heapPerFrame = static_cast<double>(heapAllocations.load() - before) / frames;
+
+	arenaFrame(0); // the first frame grows the arena to fit
+	before = heapAllocations.load();
+	frames = 0;
+	double arenaNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			arenaFrame(static_cast<int>(i));
+		}
+		frames += n;
+	});
+	double arenaPerFrame = static_cast<double>(heapAllocations.load() - before) / frames;
+
+	Report("arena/frame temporaries heap", heapNs, "frame");
+	std::printf("%-28s %12.2f mallocs/frame\n", "", heapPerFrame);
+	Report("arena/frame temporaries", arenaNs, "frame");
+	std::printf("%-28s %12.2f mallocs/frame, high-water %zu bytes\n", "", arenaPerFrame, arena.HighWater());
+
+	int cores = static_cast<int>(std::thread::hardware_concurrency());
+	WorkerPool pool(cores < 1 ? 1 : cores);
+	FrameArenas arenas(pool.Size(), 1024);
+	auto work = [&](int worker)
+	{
+		FrameVector<Contact> contacts{ArenaAllocator<Contact>(arenas[worker])};
+		for (int i = 0; i < 256; ++i)
+		{
+			contacts.push_back({CollisionType::Top, Scalar(i)});
+		}
+		arenas[worker].Format("worker %d: %zu contacts", worker, contacts.size());
+	};
+	pool.Run(work);
+	arenas.ResetAll();
+
+	before = heapAllocations.load();
+	frames = 0;
+	double poolNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			pool.Run(work);
+			arenas.ResetAll();
+		}
+		frames += n;
+	});
+	char name[64];
+	std::snprintf(name, sizeof(name), "arena/%d worker arenas", pool.Size());
+	Report(name, poolNs, "frame");
+	std::printf("%-28s %12.2f mallocs/frame, high-water %zu bytes per worker\n", "",
+				static_cast<double>(heapAllocations.load() - before) / frames, arenas.HighWater());
+}
+
+// A frame of a field full of sparks: integrate and build the vertex buffer.
+// Bursts keep coming so particles are born, fade and get culled throughout.
+static void BenchParticles(int live)
+{
+	ParticlePool pool;
+	Burst burst{WIDTH / 2.0f, HEIGHT / 2.0f, 0.0f, 2500, 0.3f, 60000.0f, 0xFF, 0xFF, 0xFF};
+	while (pool.Count() < live)
+	{
+		pool.Emit(burst);
+	}
+	pool.Cull(live);
+
+	const float FRAME_MS = 1000.0f / 60.0f;
+	long long before = heapAllocations.load();
+	long long frames = 0;
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			burst.x = static_cast<float>((frames + i) * 37 % WIDTH);
+			pool.Emit(burst);
+			pool.Cull(live);
+			pool.Update(FRAME_MS);
+			sink = static_cast<float>(pool.BuildVertices());
+		}
+		frames += n;
+	});
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "particles/%dk live", live / 1000);
+	Report(name, ns, "frame");
+	std::printf("%-28s %12.2f mallocs/frame, %.1f%% of a 60 fps frame\n", "",
+				static_cast<double>(heapAllocations.load() - before) / frames, ns / (FRAME_MS * 1.0e4));
+}
+
+// Not a timing: the tiled SIMD renderer against the one pixel at a time
+// reference, first every source, destination and alpha through the blend,
+// then whole frames of a bot match.
+static void CheckTiles(MatchCanvas &canvas)
+{
+	long long wrong = 0;
+	uint8_t src[4 * 8], dst[4 * 8], expected[4 * 8];
+	for (int a = 0; a < 256; ++a)
+	{
+		for (int s = 0; s < 256; ++s)
+		{
+			for (int d = 0; d < 256; d += 8)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					src[4 * i] = src[4 * i + 1] = src[4 * i + 2] = static_cast<uint8_t>(s);
+					src[4 * i + 3] = static_cast<uint8_t>(a);
+					dst[4 * i] = dst[4 * i + 1] = static_cast<uint8_t>(d + i);
+					dst[4 * i + 2] = static_cast<uint8_t>(255 - d - i);
+					dst[4 * i + 3] = static_cast<uint8_t>(d + i);
+				}
+				std::memcpy(expected, dst, sizeof(dst));
+				for (int i = 0; i < 8; ++i)
+				{
+					BlendPixel(expected + 4 * i, src + 4 * i);
+				}
+				BlendSpan(dst, src, 8);
+				wrong += std::memcmp(dst, expected, sizeof(dst)) != 0;
+			}
+		}
+	}
+
+	TileRenderer renderer(static_cast<int>(std::thread::hardware_concurrency()));
+	canvas.SetBackground(renderer);
+	std::vector<uint8_t> tiled(static_cast<size_t>(WIDTH) * HEIGHT * 4), reference(tiled.size());
+	Match match;
+	bool buttons[4] = {};
+	AiParams params;
+	int frames = 0;
+	for (int tick = 0; tick < 6000; ++tick)
+	{
+		ApplyAi(match, Team::One, DecideAi(match, Team::One, params), buttons);
+		ApplyAi(match, Team::Two, DecideAi(match, Team::Two, params), buttons);
+		match.ApplyButtons(buttons);
+		match.Update(TICK_MS);
+		if (tick % 20 == 0)
+		{
+			canvas.Queue(renderer, match);
+			renderer.Render(tiled.data());
+			renderer.RenderReference(reference.data());
+			wrong += tiled != reference;
+			++frames;
+		}
+	}
+	std::printf("%-28s %s (%d frames)\n", "tiles/reference", wrong == 0 ? "bit-exact" : "MISMATCH", frames);
+}
+
+// One full resolution frame of a match through the tiled renderer
+static void BenchTiles(MatchCanvas &canvas, int threads)
+{
+	TileRenderer renderer(threads);
+	canvas.SetBackground(renderer);
+	std::vector<uint8_t> frame(static_cast<size_t>(WIDTH) * HEIGHT * 4);
+	Match match;
+	bool buttons[4] = {};
+	AiParams params;
+	long long before = heapAllocations.load();
+	long long frames = 0;
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			ApplyAi(match, Team::One, DecideAi(match, Team::One, params), buttons);
+			ApplyAi(match, Team::Two, DecideAi(match, Team::Two, params), buttons);
+			match.ApplyButtons(buttons);
+			match.Update(TICK_MS);
+			canvas.Queue(renderer, match);
+			renderer.Render(frame.data());
+		}
+		sink = frame[frame.size() / 2];
+		frames += n;
+	});
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "tiles/%dx%d/%d thr", WIDTH, HEIGHT, threads);
+	Report(name, ns, "frame");
+	std::printf("%-28s %12.2f mallocs/frame\n", "", static_cast<double>(heapAllocations.load() - before) / frames);
+}
+
+// One audio callback's worth of mixing with every voice busy, and the cost
+// of passing a play command through the queue
+static void BenchMixer()
+{
+	Mixer mixer;
+	float out[2 * AUDIO_FRAMES];
+	long long frames = 0;
+	double ns = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			while (mixer.Playing() < MAX_VOICES && mixer.Play(Sound::Goal, 0.5f, 0.0f))
+			{
+				mixer.Mix(out, 0);
+			}
+			mixer.Mix(out, AUDIO_FRAMES);
+		}
+		frames += n;
+	});
+	sink = out[0];
+
+	const float CALLBACK_NS = 1.0e9f * AUDIO_FRAMES / AUDIO_RATE;
+	Report("audio/mix 64 voices", ns, "callback");
+	std::printf("%-28s %12.2f%% of the %.1f ms callback period\n", "", 100.0 * ns / CALLBACK_NS, CALLBACK_NS / 1.0e6f);
+
+	SpscQueue<PlayCommand, SOUND_QUEUE_SIZE> queue;
+	PlayCommand command{Sound::Kick, 0.8f, 0.0f};
+	double queueNs = Measure([&](long long n)
+	{
+		for (long long i = 0; i < n; ++i)
+		{
+			queue.Push(command);
+			queue.Pop(command);
+		}
+	});
+	sink = command.gain;
+	Report("audio/queue push+pop", queueNs, "play");
+}
+
+int main(int argc, char *argv[])
+{
+	std::string filter = argc > 1 ? argv[1] : "";
+	auto wanted = [&](char const *name) { return std::strncmp(name, filter.c_str(), filter.size()) == 0; };
+
+	if (wanted("match"))
+	{
+		ReportChecksum();
+		BenchMatchUpdate(2);
+		BenchMatchUpdate(5);
+		BenchMatchUpdate(11);
+	}
+	if (wanted("ai"))
+	{
+		BenchAiDecide();
+	}
+	if (wanted("raster"))
+	{
+		BenchRaster(84, 1);
+		BenchRaster(84, 3);
+	}
+	if (wanted("snapshot"))
+	{
+		BenchSnapshot(0);
+		BenchSnapshot(2);
+		BenchSnapshot(16);
+		CheckSnapshotStream(2);
+		CheckSnapshotStream(16);
+	}
+	if (wanted("replay"))
+	{
+		BenchReplaySeek();
+	}
+	if (wanted("spectator"))
+	{
+		BenchSpectator();
+	}
+	if (wanted("arena"))
+	{
+		BenchArena();
+	}
+	if (wanted("audio"))
+	{
+		BenchMixer();
+	}
+	if (wanted("particles"))
+	{
+		BenchParticles(10000);
+		BenchParticles(50000);
+	}
+	if (wanted("tiles"))
+	{
+		// The real art when the pack has been built, stand-ins otherwise
+		AssetPack pack;
+		pack.Open(std::string("assets/") + PACK_NAME);
+		MatchCanvas canvas(&pack);
+		CheckTiles(canvas);
+		int cores = static_cast<int>(std::thread::hardware_concurrency());
+		BenchTiles(canvas, 1);
+		if (cores > 1)
+		{
+			BenchTiles(canvas, cores);
+		}
+	}
+	if (wanted("botlink"))
+	{
+		BenchBotLink();
+	}
+	if (wanted("vecenv"))
+	{
+		int cores = static_cast<int>(std::thread::hardware_concurrency());
+		BenchVecEnv(4096, 1);
+		BenchVecEnvRender(1024, 1);
+		if (cores > 1)
+		{
+			BenchVecEnv(4096, cores);
+			BenchVecEnvRender(1024, cores);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
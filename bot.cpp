@@ -0,0 +1,65 @@
+// An example bot that plays in its own process. Start the game with
+// --bot blue or --bot red, then this with the same team; it can come and go
+// while the game runs.
+//
+//   bot --team red           play Red with the built in AI
+//   bot --team blue --error 12
+//                            play Blue, misjudging the ball by 12 px
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "game.h"
+#include "ai.h"
+#include "botlink.h"
+
+int main(int argc, char *argv[])
+{
+	Team team = Team::Two;
+	AiParams params;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (flag == "--team" && i + 1 < argc && (std::string(argv[i + 1]) == "blue" || std::string(argv[i + 1]) == "red"))
+		{
+			team = std::string(argv[++i]) == "blue" ? Team::One : Team::Two;
+		}
+		else if (flag == "--error" && i + 1 < argc)
+		{
+			params.error = static_cast<float>(std::atof(argv[++i]));
+		}
+		else
+		{
+			std::printf("Usage: bot [--team blue|red] [--error PX]\n");
+			return 1;
+		}
+	}
+
+	BotClient client;
+	std::string name = BotChannelName(team);
+	if (!client.Attach(name))
+	{
+		std::printf("No game is waiting for a bot on %s\n", name.c_str());
+		return 1;
+	}
+	std::printf("Playing %s\n", team == Team::One ? "Blue" : "Red");
+
+	uint64_t decisions = 0;
+	for (;;)
+	{
+		if (!client.Wait(1000.0f))
+		{
+			continue;
+		}
+
+		client.Answer(AiInput(DecideAi(client.State(), client.GetTeam(), params)));
+
+		if (++decisions % 1250 == 0)
+		{
+			Match const &state = client.State();
+			std::printf("tick %u  Blue %d - %d Red\n", client.Tick(), state.playerOneScore, state.playerTwoScore);
+		}
+	}
+}
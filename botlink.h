@@ -0,0 +1,366 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "game.h"
+#include "sharedmem.h"
+#include "snapshot.h"
+
+// Bots in their own process. The game and one bot share a small block of
+// memory: every tick the game writes the match as an observation and bumps
+// the request number, the bot answers with InputBits for its team's
+// current paddle and bumps the response number. Both sides sleep on those
+// numbers with futexes, so a round trip is a couple of context switches.
+// The game waits for an answer only until a per tick deadline; a late or
+// missing bot keeps doing whatever it last asked for.
+
+const uint32_t BOT_MAGIC = 0x4C424254; // "TBBL"
+const uint32_t BOT_VERSION = 2;
+const float BOT_DEADLINE_MS = 2.0f;
+const int BOT_GIVE_UP = 16; // deadlines missed in a row before the game stops waiting
+
+inline std::string BotChannelName(Team team)
+{
+	return team == Team::One ? "/tinyball-bot-blue" : "/tinyball-bot-red";
+}
+
+// A counter the other process can sleep on until it moves. The sleeper count
+// lets Bump skip the wake system call when nobody is asleep.
+struct WaitWord
+{
+	std::atomic<uint32_t> value;
+	std::atomic<uint32_t> sleepers;
+
+	void Bump(uint32_t to)
+	{
+		value.store(to);
+		if (sleepers.load() != 0)
+		{
+#ifdef __linux__
+			syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+		}
+	}
+
+	// Wait while value == seen, for at most timeoutMs. Returns the value.
+	uint32_t WaitWhile(uint32_t seen, float timeoutMs)
+	{
+		// A short spin catches answers that are already on their way
+		for (int spin = 0; spin < 256; ++spin)
+		{
+			uint32_t now = value.load(std::memory_order_acquire);
+			if (now != seen)
+			{
+				return now;
+			}
+		}
+
+		using Clock = std::chrono::steady_clock;
+		auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+											 std::chrono::duration<float, std::milli>(timeoutMs));
+		uint32_t now;
+		while ((now = value.load()) == seen)
+		{
+			auto left = deadline - Clock::now();
+			if (left <= Clock::duration::zero())
+			{
+				break;
+			}
+#ifdef __linux__
+			long ns = static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(left).count());
+			timespec timeout{ns / 1000000000, ns % 1000000000};
+			sleepers.fetch_add(1);
+			if (value.load() == seen)
+			{
+				syscall(SYS_futex, reinterpret_cast<uint32_t *>(&value), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+			}
+			sleepers.fetch_sub(1);
+#else
+			std::this_thread::yield();
+#endif
+		}
+		return now;
+	}
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futexes work on plain 32 bit words");
+
+struct BotChannel
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t team; // 0 Blue, 1 Red
+	uint32_t fieldCount;
+	uint32_t rules[5]; // ballSpeed, paddleSpeed, paddleHeight as Scalar bits, matchTime as float bits, teamSize
+	std::atomic<uint32_t> attached;
+
+	// Game to bot. sequence is odd while the observation is being written.
+	alignas(64) WaitWord request;
+	std::atomic<uint32_t> sequence;
+	std::atomic<uint32_t> tick;
+	std::atomic<int32_t> observation[FieldCount];
+
+	// Bot to game, on its own cache line
+	alignas(64) WaitWord response; // the request this answers
+	std::atomic<uint32_t> action;
+};
+
+// The game's end of one bot's channel
+class BotLink
+{
+public:
+	struct Stats
+	{
+		uint64_t requests = 0;
+		uint64_t answered = 0; // in time
+		uint64_t late = 0;
+		double maxRoundTripUs = 0.0;
+	};
+
+	bool Open(Team team, Rules const &rules, std::string const &name = "")
+	{
+		if (!region.Open(name.empty() ? BotChannelName(team) : name, sizeof(BotChannel), SharedAccess::Create))
+		{
+			channel = nullptr;
+			return false;
+		}
+
+		channel = static_cast<BotChannel *>(region.Memory());
+		channel->version = BOT_VERSION;
+		channel->team = team == Team::One ? 0 : 1;
+		channel->fieldCount = FieldCount;
+		channel->rules[0] = ScalarBits(rules.ballSpeed);
+		channel->rules[1] = ScalarBits(rules.paddleSpeed);
+		channel->rules[2] = ScalarBits(rules.paddleHeight);
+		std::memcpy(&channel->rules[3], &rules.matchTime, sizeof(float));
+		channel->rules[4] = static_cast<uint32_t>(TeamSizeOf(rules));
+		channel->attached.store(0);
+		channel->request.value.store(0);
+		channel->request.sleepers.store(0);
+		channel->response.value.store(0);
+		channel->response.sleepers.store(0);
+		channel->sequence.store(0);
+		channel->action.store(0);
+		std::atomic_thread_fence(std::memory_order_release);
+		channel->magic = BOT_MAGIC;
+
+		codec = SnapshotCodec(Precision::Quantized, rules);
+		request = 0;
+		lastAnswered = 0;
+		lastAction = 0;
+		return true;
+	}
+
+	bool IsOpen() const { return channel != nullptr; }
+	bool Attached() const { return channel && channel->attached.load(std::memory_order_relaxed); }
+
+	// The bot's input for the tick about to run on match. Waits at most
+	// deadlineMs; without a fresh answer the previous one is used again.
+	uint8_t Decide(Match const &match, uint32_t tick, float deadlineMs = BOT_DEADLINE_MS)
+	{
+		if (!channel)
+		{
+			return 0;
+		}
+
+		Snapshot snapshot = codec.Capture(match, tick);
+		uint32_t sequence = channel->sequence.load(std::memory_order_relaxed);
+		channel->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		channel->tick.store(tick, std::memory_order_relaxed);
+		for (int field = 0; field < FieldCount; ++field)
+		{
+			channel->observation[field].store(snapshot.values[field], std::memory_order_relaxed);
+		}
+		channel->sequence.store(sequence + 2, std::memory_order_release);
+
+		// A bot that stopped answering is not waited for until it has caught
+		// up with the previous request, however late
+		uint32_t answered = channel->response.value.load(std::memory_order_acquire);
+		if (answered == request)
+		{
+			missed = 0;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+									std::chrono::duration<float, std::milli>(deadlineMs));
+		channel->request.Bump(++request);
+		++stats.requests;
+
+		if (Attached() && missed < BOT_GIVE_UP)
+		{
+			// A late answer to an older request may show up first
+			while (answered != request)
+			{
+				float left = std::chrono::duration<float, std::milli>(deadline - std::chrono::steady_clock::now()).count();
+				if (left <= 0.0f)
+				{
+					break;
+				}
+				answered = channel->response.WaitWhile(answered, left);
+			}
+		}
+
+		if (answered == request)
+		{
+			double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			stats.maxRoundTripUs = us > stats.maxRoundTripUs ? us : stats.maxRoundTripUs;
+			++stats.answered;
+			missed = 0;
+		}
+		else
+		{
+			++stats.late;
+			++missed;
+		}
+
+		// Even a late answer is the newest thing the bot asked for. Repeats
+		// keep only the held buttons so a switch is not pressed twice.
+		if (answered == lastAnswered)
+		{
+			return static_cast<uint8_t>(lastAction & (InputUp | InputDown));
+		}
+		lastAnswered = answered;
+		lastAction = static_cast<uint8_t>(channel->action.load(std::memory_order_acquire));
+		return lastAction;
+	}
+
+	Stats stats;
+
+private:
+	SharedRegion region;
+	BotChannel *channel = nullptr;
+	SnapshotCodec codec;
+	uint32_t request = 0;
+	uint32_t lastAnswered = 0;
+	uint8_t lastAction = 0;
+	int missed = 0;
+};
+
+// The bot's end
+class BotClient
+{
+public:
+	~BotClient()
+	{
+		Detach();
+	}
+
+	bool Attach(std::string const &name)
+	{
+		if (!region.Open(name, sizeof(BotChannel), SharedAccess::ReadWrite))
+		{
+			return false;
+		}
+
+		BotChannel *mapped = static_cast<BotChannel *>(region.Memory());
+		if (mapped->magic != BOT_MAGIC || mapped->version != BOT_VERSION || mapped->fieldCount != FieldCount)
+		{
+			region.Close();
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		channel = mapped;
+
+		rules.ballSpeed = BitsScalar(channel->rules[0]);
+		rules.paddleSpeed = BitsScalar(channel->rules[1]);
+		rules.paddleHeight = BitsScalar(channel->rules[2]);
+		std::memcpy(&rules.matchTime, &channel->rules[3], sizeof(float));
+		rules.teamSize = static_cast<int>(channel->rules[4]);
+		codec = SnapshotCodec(Precision::Quantized, rules);
+		match = Match(rules);
+
+		seen = channel->request.value.load();
+		channel->attached.store(1);
+		return true;
+	}
+
+	void Detach()
+	{
+		if (channel)
+		{
+			channel->attached.store(0);
+			channel = nullptr;
+		}
+		region.Close();
+	}
+
+	Team GetTeam() const { return channel && channel->team ? Team::Two : Team::One; }
+	Rules const &GetRules() const { return rules; }
+
+	// Sleep until the game asks for a decision, at most timeoutMs. Requests
+	// that came and went while the bot was busy are skipped; only the
+	// newest matters.
+	bool Wait(float timeoutMs)
+	{
+		if (!channel)
+		{
+			return false;
+		}
+
+		uint32_t now = channel->request.WaitWhile(seen, timeoutMs);
+		if (now == seen)
+		{
+			return false;
+		}
+
+		for (;;)
+		{
+			// The request number first: the observation it announces is
+			// already written, or a newer one is
+			uint32_t number = channel->request.value.load(std::memory_order_acquire);
+			uint32_t before = channel->sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				continue;
+			}
+
+			snapshot.tick = channel->tick.load(std::memory_order_relaxed);
+			for (int field = 0; field < FieldCount; ++field)
+			{
+				snapshot.values[field] = channel->observation[field].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (channel->sequence.load(std::memory_order_relaxed) == before)
+			{
+				seen = number;
+				codec.Apply(snapshot, match);
+				return true;
+			}
+		}
+	}
+
+	// The match as of the last Wait
+	Match const &State() const { return match; }
+	uint32_t Tick() const { return snapshot.tick; }
+
+	void Answer(uint8_t input)
+	{
+		channel->action.store(input, std::memory_order_release);
+		channel->response.Bump(seen);
+	}
+
+private:
+	SharedRegion region;
+	BotChannel *channel = nullptr;
+	Rules rules;
+	SnapshotCodec codec;
+	Match match;
+	Snapshot snapshot;
+	uint32_t seen = 0;
+};
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio.h" // SpscQueue
+#include "pool.h"
+
+// Records the frames the game shows, as a numbered PNG sequence in a
+// directory or as one raw Y4M video (a path ending in .y4m). The game
+// copies each frame into one of a few preallocated buffers and hands it to
+// an encoder thread through a wait-free queue; finished buffers come back
+// the same way. When every buffer is still queued the frame is dropped and
+// counted, so a slow disk costs frames in the video, never frames on
+// screen. PNG frames are encoded several at a time on a WorkerPool; a Y4M
+// stream is written in order on the encoder thread. Nothing here depends
+// on SDL (main.cpp reads the pixels back).
+
+const int CAPTURE_SLOTS = 8; // 133 ms of slack at 60 fps
+const int CAPTURE_FPS = 60;
+
+inline uint32_t Crc32(uint32_t crc, uint8_t const *data, size_t size)
+{
+	static const std::vector<uint32_t> table = []()
+	{
+		std::vector<uint32_t> entries(256);
+		for (uint32_t n = 0; n < 256; ++n)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; ++k)
+			{
+				c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+			}
+			entries[n] = c;
+		}
+		return entries;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+// RGB PNG of RGBA pixels (alpha is dropped). The deflate stream is stored,
+// not compressed, so writing keeps up with the game; squeeze the files
+// afterwards if size matters. scratch is reused between calls.
+inline bool WritePng(std::string const &path, uint8_t const *rgba, int width, int height, std::vector<uint8_t> &scratch)
+{
+	auto put32 = [](uint8_t *at, uint32_t value)
+	{
+		at[0] = static_cast<uint8_t>(value >> 24);
+		at[1] = static_cast<uint8_t>(value >> 16);
+		at[2] = static_cast<uint8_t>(value >> 8);
+		at[3] = static_cast<uint8_t>(value);
+	};
+
+	// Rows of a filter byte (none) and RGB, cut into stored blocks of at
+	// most 65535 bytes, inside a zlib wrapper, inside the IDAT chunk
+	const size_t BLOCK = 65535;
+	size_t raw = static_cast<size_t>(height) * (1 + 3 * static_cast<size_t>(width));
+	size_t blocks = raw == 0 ? 1 : (raw + BLOCK - 1) / BLOCK;
+	size_t length = 2 + 5 * blocks + raw + 4;
+	scratch.resize(8 + length + 4);
+	uint8_t *chunk = scratch.data();
+	put32(chunk, static_cast<uint32_t>(length));
+	std::memcpy(chunk + 4, "IDAT", 4);
+	uint8_t *out = chunk + 8;
+	*out++ = 0x78;
+	*out++ = 0x01;
+
+	uint32_t a = 1, b = 0; // Adler-32 of the raw rows
+	size_t left = 0;       // in the current block
+	size_t done = 0;
+	auto emit = [&](uint8_t byte)
+	{
+		if (left == 0)
+		{
+			size_t size = raw - done < BLOCK ? raw - done : BLOCK;
+			*out++ = done + size == raw ? 1 : 0;
+			*out++ = static_cast<uint8_t>(size);
+			*out++ = static_cast<uint8_t>(size >> 8);
+			*out++ = static_cast<uint8_t>(~size);
+			*out++ = static_cast<uint8_t>(~size >> 8);
+			left = size;
+		}
+		*out++ = byte;
+		--left;
+		++done;
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	};
+	for (int y = 0; y < height; ++y)
+	{
+		emit(0);
+		uint8_t const *row = rgba + static_cast<size_t>(y) * width * 4;
+		for (int x = 0; x < width; ++x)
+		{
+			emit(row[4 * x]);
+			emit(row[4 * x + 1]);
+			emit(row[4 * x + 2]);
+		}
+	}
+	put32(out, b << 16 | a);
+	put32(chunk + 8 + length, Crc32(0, chunk + 4, length + 4));
+
+	uint8_t head[8 + 25];
+	std::memcpy(head, "\x89PNG\r\n\x1a\n", 8);
+	put32(head + 8, 13);
+	std::memcpy(head + 12, "IHDR", 4);
+	put32(head + 16, static_cast<uint32_t>(width));
+	put32(head + 20, static_cast<uint32_t>(height));
+	uint8_t const FORMAT[] = {8, 2, 0, 0, 0}; // 8 bit RGB, deflate, no interlace
+	std::memcpy(head + 24, FORMAT, 5);
+	put32(head + 29, Crc32(0, head + 12, 17));
+	uint8_t const END[] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+
+	std::FILE *file = std::fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool written = std::fwrite(head, sizeof(head), 1, file) == 1 && std::fwrite(scratch.data(), scratch.size(), 1, file) == 1 &&
+				   std::fwrite(END, sizeof(END), 1, file) == 1;
+	return std::fclose(file) == 0 && written;
+}
+
+// BT.601 studio range 4:2:0, the Y plane then U then V. Chroma is the
+// average of each 2 x 2 block; odd edges repeat the last pixel.
+inline void RgbaToI420(uint8_t const *rgba, int width, int height, uint8_t *out)
+{
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	uint8_t *luma = out;
+	uint8_t *u = out + static_cast<size_t>(width) * height;
+	uint8_t *v = u + static_cast<size_t>(chromaWidth) * chromaHeight;
+	for (int y = 0; y < height; ++y)
+	{
+		uint8_t const *row = rgba + static_cast<size_t>(y) * width * 4;
+		for (int x = 0; x < width; ++x)
+		{
+			int r = row[4 * x], g = row[4 * x + 1], b = row[4 * x + 2];
+			luma[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		}
+	}
+	for (int y = 0; y < chromaHeight; ++y)
+	{
+		for (int x = 0; x < chromaWidth; ++x)
+		{
+			int r = 0, g = 0, b = 0;
+			for (int k = 0; k < 4; ++k)
+			{
+				int atX = 2 * x + (k & 1) < width ? 2 * x + (k & 1) : width - 1;
+				int atY = 2 * y + (k >> 1) < height ? 2 * y + (k >> 1) : height - 1;
+				uint8_t const *pixel = rgba + (static_cast<size_t>(atY) * width + atX) * 4;
+				r += pixel[0];
+				g += pixel[1];
+				b += pixel[2];
+			}
+			r = (r + 2) / 4;
+			g = (g + 2) / 4;
+			b = (b + 2) / 4;
+			u[static_cast<size_t>(y) * chromaWidth + x] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+			v[static_cast<size_t>(y) * chromaWidth + x] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+		}
+	}
+}
+
+class FrameCapture
+{
+public:
+	FrameCapture() = default;
+
+	~FrameCapture()
+	{
+		Close();
+	}
+
+	FrameCapture(FrameCapture const &) = delete;
+	FrameCapture &operator=(FrameCapture const &) = delete;
+
+	// A PNG directory (which must exist) or a .y4m file. Empty on success.
+	std::string Open(std::string const &path, int width, int height, int fps = CAPTURE_FPS, int threads = 2)
+	{
+		Close();
+		y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+		if (y4m)
+		{
+			file = std::fopen(path.c_str(), "wb");
+			if (!file)
+			{
+				return "cannot write " + path;
+			}
+			std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+		}
+		directory = path.empty() || path.back() == '/' ? path : path + "/";
+		this->width = width;
+		this->height = height;
+
+		int stale;
+		while (free.Pop(stale) || filled.Pop(stale))
+		{
+		}
+		slots.assign(CAPTURE_SLOTS, Slot());
+		for (int n = 0; n < CAPTURE_SLOTS; ++n)
+		{
+			slots[n].pixels.resize(static_cast<size_t>(width) * height * 4);
+			free.Push(n);
+		}
+		pool.reset(new WorkerPool(y4m ? 1 : threads));
+		scratch.assign(pool->Size(), std::vector<uint8_t>());
+		stopping = false;
+		thread = std::thread([this]() { Encode(); });
+		return "";
+	}
+
+	bool IsOpen() const { return thread.joinable(); }
+	int Width() const { return width; }
+	int Height() const { return height; }
+
+	// Game thread. Width() * Height() RGBA pixels to fill, or null when the
+	// encoders are behind, in which case this frame is dropped. Wait-free.
+	uint8_t *Acquire()
+	{
+		long long number = frames++;
+		if (!free.Pop(filling))
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		slots[filling].number = number;
+		return slots[filling].pixels.data();
+	}
+
+	// Game thread. Queues the buffer Acquire handed out.
+	void Submit()
+	{
+		filled.Push(filling);
+		ready.notify_one();
+	}
+
+	// Writes whatever is still queued, then stops
+	void Close()
+	{
+		if (thread.joinable())
+		{
+			stopping = true;
+			ready.notify_one();
+			thread.join();
+		}
+		if (file)
+		{
+			std::fclose(file);
+			file = nullptr;
+		}
+		pool.reset();
+	}
+
+	// Readable from any thread. Frames are numbered from 0 including the
+	// dropped ones, so gaps in a PNG sequence show where they were.
+	long long Written() const { return written.load(std::memory_order_relaxed); }
+	long long Dropped() const { return dropped.load(std::memory_order_relaxed); }
+	long long Failed() const { return failed.load(std::memory_order_relaxed); }
+
+private:
+	struct Slot
+	{
+		std::vector<uint8_t> pixels;
+		long long number = 0;
+	};
+
+	// Encoder thread: take up to one frame per pool thread, write them, and
+	// hand the buffers back
+	void Encode()
+	{
+		std::vector<int> batch;
+		for (;;)
+		{
+			bool last = stopping;
+			batch.clear();
+			int slot;
+			while (static_cast<int>(batch.size()) < pool->Size() && filled.Pop(slot))
+			{
+				batch.push_back(slot);
+			}
+			if (batch.empty())
+			{
+				if (last)
+				{
+					return;
+				}
+				// The game never takes this lock; the timeout covers a
+				// notify that lands before the wait
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait_for(lock, std::chrono::milliseconds(5));
+				continue;
+			}
+
+			pool->Run([&](int t)
+			{
+				if (t < static_cast<int>(batch.size()))
+				{
+					Write(slots[batch[t]], scratch[t]);
+				}
+			});
+			for (int done : batch)
+			{
+				free.Push(done);
+			}
+		}
+	}
+
+	void Write(Slot const &slot, std::vector<uint8_t> &buffer)
+	{
+		bool ok;
+		if (y4m)
+		{
+			buffer.resize(static_cast<size_t>(width) * height + 2 * static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2));
+			RgbaToI420(slot.pixels.data(), width, height, buffer.data());
+			ok = std::fwrite("FRAME\n", 6, 1, file) == 1 && std::fwrite(buffer.data(), buffer.size(), 1, file) == 1;
+		}
+		else
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "frame_%06lld.png", slot.number);
+			ok = WritePng(directory + name, slot.pixels.data(), width, height, buffer);
+		}
+		(ok ? written : failed).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::vector<Slot> slots;
+	SpscQueue<int, CAPTURE_SLOTS> free;   // encoder to game
+	SpscQueue<int, CAPTURE_SLOTS> filled; // game to encoder
+	int filling = 0;
+	long long frames = 0;
+
+	bool y4m = false;
+	std::string directory;
+	std::FILE *file = nullptr;
+	int width = 0, height = 0;
+
+	std::unique_ptr<WorkerPool> pool;
+	std::vector<std::vector<uint8_t>> scratch; // per pool thread
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::atomic<bool> stopping{false};
+	std::atomic<long long> written{0};
+	std::atomic<long long> dropped{0};
+	std::atomic<long long> failed{0};
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <vector>
+
+#include "game.h"
+
+// Which parts of the window changed since the last frame, for renderers
+// that pay for every pixel they touch. Each frame the caller lists the
+// bounds of everything it draws; anything whose bounds are not exactly
+// where they were last frame dirties both its old and new place. Finish
+// merges the regions into a few rectangles, and only those are repainted
+// from the cached background and sent to the screen. Nothing here depends
+// on SDL (main.cpp does the drawing).
+
+// Past this share of the window one full repaint is cheaper than the pieces
+const float DIRTY_FULL_FRACTION = 0.5f;
+
+struct DirtyRect
+{
+	int x, y, w, h;
+
+	bool Empty() const { return w <= 0 || h <= 0; }
+	long long Area() const { return Empty() ? 0 : static_cast<long long>(w) * h; }
+
+	bool operator==(DirtyRect const &other) const
+	{
+		return x == other.x && y == other.y && w == other.w && h == other.h;
+	}
+};
+
+class DirtyRegions
+{
+public:
+	explicit DirtyRegions(int width = WIDTH, int height = HEIGHT) : width(width), height(height)
+	{
+	}
+
+	// Something drawn this frame at these bounds
+	void Drawn(DirtyRect bounds)
+	{
+		if (!bounds.Empty())
+		{
+			current.push_back(bounds);
+		}
+	}
+
+	// Repaint this area even if nothing there moved, e.g. new text
+	void Mark(DirtyRect bounds)
+	{
+		if (!bounds.Empty())
+		{
+			marked.push_back(bounds);
+		}
+	}
+
+	// Repaint everything, e.g. after the window was uncovered
+	void MarkAll()
+	{
+		all = true;
+	}
+
+	// Work out this frame's rectangles. Call once everything has been
+	// listed with Drawn, before painting.
+	void Finish()
+	{
+		for (DirtyRect const &rect : current)
+		{
+			if (!Contains(previous, rect))
+			{
+				marked.push_back(rect);
+			}
+		}
+		for (DirtyRect const &rect : previous)
+		{
+			if (!Contains(current, rect))
+			{
+				marked.push_back(rect);
+			}
+		}
+		previous.swap(current);
+		current.clear();
+
+		rects.clear();
+		for (DirtyRect const &rect : marked)
+		{
+			DirtyRect clipped = Clip(rect);
+			if (!clipped.Empty())
+			{
+				rects.push_back(clipped);
+			}
+		}
+		marked.clear();
+		Merge();
+
+		long long area = 0;
+		for (DirtyRect const &rect : rects)
+		{
+			area += rect.Area();
+		}
+		long long window = static_cast<long long>(width) * height;
+		if (all || area > DIRTY_FULL_FRACTION * window)
+		{
+			rects.assign(1, DirtyRect{0, 0, width, height});
+			area = window;
+			++fullFrames;
+		}
+		all = false;
+		painted += area;
+		++frames;
+	}
+
+	// This frame's rectangles, disjoint enough to paint one at a time
+	std::vector<DirtyRect> const &Rects() const { return rects; }
+
+	// Share of the window repainted, averaged over every frame so far
+	float PaintedFraction() const
+	{
+		return frames == 0 ? 0.0f : static_cast<float>(painted) / (static_cast<float>(frames) * width * height);
+	}
+
+	long long Frames() const { return frames; }
+	long long FullFrames() const { return fullFrames; }
+
+private:
+	static bool Contains(std::vector<DirtyRect> const &list, DirtyRect const &rect)
+	{
+		for (DirtyRect const &other : list)
+		{
+			if (other == rect)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	static DirtyRect Union(DirtyRect const &a, DirtyRect const &b)
+	{
+		int left = a.x < b.x ? a.x : b.x;
+		int top = a.y < b.y ? a.y : b.y;
+		int right = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+		int bottom = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+		return DirtyRect{left, top, right - left, bottom - top};
+	}
+
+	DirtyRect Clip(DirtyRect const &rect) const
+	{
+		int left = rect.x < 0 ? 0 : rect.x;
+		int top = rect.y < 0 ? 0 : rect.y;
+		int right = rect.x + rect.w > width ? width : rect.x + rect.w;
+		int bottom = rect.y + rect.h > height ? height : rect.y + rect.h;
+		return DirtyRect{left, top, right - left, bottom - top};
+	}
+
+	// Join any two rectangles whose union costs no more than painting them
+	// apart. That folds in every overlap (so nothing is painted twice, which
+	// would blend translucent edges twice) and a moving sprite's old and new
+	// bounds into one. There are a handful of rectangles, so pairs are fine.
+	void Merge()
+	{
+		bool joined = true;
+		while (joined)
+		{
+			joined = false;
+			for (size_t i = 0; i < rects.size() && !joined; ++i)
+			{
+				for (size_t j = i + 1; j < rects.size(); ++j)
+				{
+					DirtyRect both = Union(rects[i], rects[j]);
+					if (Overlap(rects[i], rects[j]) || both.Area() <= rects[i].Area() + rects[j].Area())
+					{
+						rects[i] = both;
+						rects.erase(rects.begin() + j);
+						joined = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	static bool Overlap(DirtyRect const &a, DirtyRect const &b)
+	{
+		return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+	}
+
+	int width, height;
+	std::vector<DirtyRect> previous, current, marked, rects;
+	bool all = true; // the first frame paints everything
+	long long painted = 0;
+	long long frames = 0;
+	long long fullFrames = 0;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <type_traits>
+
+// Archetype storage for the match's entities. An archetype is one fixed set
+// of component types; every entity of that archetype is a row, and each
+// component lives in its own contiguous array indexed by row, so a system
+// that only needs positions and velocities walks exactly those two arrays.
+//
+// Capacities are fixed and there are no pointers, which keeps whatever holds
+// the archetypes (Match) plain data that can be copied with memcpy.
+
+template <typename Component, int Capacity>
+struct ComponentArray
+{
+	Component items[Capacity];
+};
+
+template <int Capacity, typename... Components>
+class Archetype : private ComponentArray<Components, Capacity>...
+{
+public:
+	static const int CAPACITY = Capacity;
+
+	template <typename Component>
+	static constexpr bool Has()
+	{
+		return (std::is_same<Component, Components>::value || ...);
+	}
+
+	int Count() const { return count; }
+
+	void Clear()
+	{
+		count = 0;
+	}
+
+	// Row of the new entity, or -1 when the archetype is full
+	int Add(Components const &...components)
+	{
+		if (count == Capacity)
+		{
+			return -1;
+		}
+
+		int row = count++;
+		((Get<Components>(row) = components), ...);
+		return row;
+	}
+
+	// Moves the last row into the gap, so rows after it are not stable
+	void Remove(int row)
+	{
+		--count;
+		((Get<Components>(row) = Get<Components>(count)), ...);
+	}
+
+	// One component's array, Count() entries long
+	template <typename Component>
+	Component *Get()
+	{
+		static_assert(Has<Component>(), "archetype does not have this component");
+		return static_cast<ComponentArray<Component, Capacity> &>(*this).items;
+	}
+
+	template <typename Component>
+	Component const *Get() const
+	{
+		static_assert(Has<Component>(), "archetype does not have this component");
+		return static_cast<ComponentArray<Component, Capacity> const &>(*this).items;
+	}
+
+	template <typename Component>
+	Component &Get(int row)
+	{
+		return Get<Component>()[row];
+	}
+
+	template <typename Component>
+	Component const &Get(int row) const
+	{
+		return Get<Component>()[row];
+	}
+
+	// Call body(component&...) for every row, for the components asked for
+	template <typename... Wanted, typename Body>
+	void Each(Body body)
+	{
+		static_assert((Has<Wanted>() && ...), "archetype does not have these components");
+		for (int row = 0; row < count; ++row)
+		{
+			body(Get<Wanted>(row)...);
+		}
+	}
+
+	template <typename... Wanted, typename Body>
+	void Each(Body body) const
+	{
+		static_assert((Has<Wanted>() && ...), "archetype does not have these components");
+		for (int row = 0; row < count; ++row)
+		{
+			body(Get<Wanted>(row)...);
+		}
+	}
+
+private:
+	int count = 0;
+};
+
+// Run body over every archetype in the list that has all the wanted
+// components, skipping the rest at compile time
+template <typename... Wanted, typename Body, typename... Archetypes>
+void EachEntity(Body body, Archetypes &...archetypes)
+{
+	auto visit = [&body](auto &archetype)
+	{
+		if constexpr ((std::decay_t<decltype(archetype)>::template Has<Wanted>() && ...))
+		{
+			archetype.template Each<Wanted...>(body);
+		}
+	};
+	(visit(archetypes), ...);
+}
@@ -0,0 +1,94 @@
+// Turns asset files into a header of byte arrays the game is built with, so
+// the executable carries its own assets (see AssetFiles in main.cpp).
+//
+//   embed --root assets --out embedded_assets.h ball.png red/image.png ...
+//
+// Names are relative to --root and are what the game asks for.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+	std::string root = "assets";
+	std::string out = "embedded_assets.h";
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (flag == "--root" && i + 1 < argc)
+		{
+			root = argv[++i];
+		}
+		else if (flag == "--out" && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else if (flag.compare(0, 2, "--") == 0)
+		{
+			std::printf("Usage: embed [--root DIR] [--out FILE] NAME...\n");
+			return 1;
+		}
+		else
+		{
+			// Make hands over paths; keep them relative to the root
+			names.push_back(flag.compare(0, root.size() + 1, root + "/") == 0 ? flag.substr(root.size() + 1) : flag);
+		}
+	}
+
+	std::FILE *header = std::fopen(out.c_str(), "w");
+	if (!header)
+	{
+		std::printf("Cannot write %s\n", out.c_str());
+		return 1;
+	}
+	std::fprintf(header, "// Generated by embed from %s/, do not edit\n#pragma once\n\n#include \"pack.h\"\n\n", root.c_str());
+
+	size_t total = 0;
+	for (size_t n = 0; n < names.size(); ++n)
+	{
+		std::string path = root + "/" + names[n];
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			std::printf("Cannot open %s\n", path.c_str());
+			std::fclose(header);
+			std::remove(out.c_str());
+			return 1;
+		}
+
+		// Aligned so a pack's pixel rows stay aligned inside it
+		std::fprintf(header, "alignas(64) constexpr unsigned char EMBEDDED_%zu[] = {", n);
+		unsigned char buffer[1 << 16];
+		size_t got;
+		size_t size = 0;
+		while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			for (size_t i = 0; i < got; ++i, ++size)
+			{
+				std::fprintf(header, size % 24 == 0 ? "\n\t%u," : "%u,", buffer[i]);
+			}
+		}
+		std::fclose(file);
+		std::fprintf(header, "\n\t0}; // %s\n\n", names[n].c_str());
+		total += size;
+		names[n] += "\", EMBEDDED_" + std::to_string(n) + ", " + std::to_string(size);
+	}
+
+	std::fprintf(header, "constexpr EmbeddedFile EMBEDDED_FILES[] = {\n");
+	for (std::string const &entry : names)
+	{
+		std::fprintf(header, "\t{\"%s},\n", entry.c_str());
+	}
+	std::fprintf(header, "\t{nullptr, nullptr, 0}};\n");
+
+	bool written = std::ferror(header) == 0;
+	if (std::fclose(header) != 0 || !written)
+	{
+		std::printf("Cannot write %s\n", out.c_str());
+		return 1;
+	}
+	std::printf("Embedded %zu files, %zu bytes, in %s\n", names.size(), total, out.c_str());
+	return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+
+// Q16.16 fixed point number. Integer arithmetic only, so a simulation built
+// on it gives the same bits on every compiler, optimisation level and CPU.
+// Range is about +-32767 with a resolution of 1/65536.
+class Fixed
+{
+public:
+	int32_t raw;
+
+	constexpr Fixed() : raw(0) {}
+
+	constexpr Fixed(int v) : raw(v * 65536) {}
+
+	// Scaling by a power of two is exact, so these are deterministic too
+	constexpr Fixed(float v) : raw(static_cast<int32_t>(v * 65536.0f + (v < 0.0f ? -0.5f : 0.5f))) {}
+
+	constexpr Fixed(double v) : raw(static_cast<int32_t>(v * 65536.0 + (v < 0.0 ? -0.5 : 0.5))) {}
+
+	static constexpr Fixed FromRaw(int32_t raw)
+	{
+		Fixed f;
+		f.raw = raw;
+		return f;
+	}
+
+	explicit constexpr operator float() const
+	{
+		return static_cast<float>(raw) / 65536.0f;
+	}
+
+	explicit constexpr operator double() const
+	{
+		return static_cast<double>(raw) / 65536.0;
+	}
+
+	// Truncates toward zero like a float to int cast
+	explicit constexpr operator int() const
+	{
+		return raw / 65536;
+	}
+
+	constexpr Fixed operator-() const
+	{
+		return FromRaw(-raw);
+	}
+
+	Fixed &operator+=(Fixed rhs)
+	{
+		raw += rhs.raw;
+		return *this;
+	}
+
+	Fixed &operator-=(Fixed rhs)
+	{
+		raw -= rhs.raw;
+		return *this;
+	}
+
+	Fixed &operator*=(Fixed rhs)
+	{
+		*this = *this * rhs;
+		return *this;
+	}
+
+	Fixed &operator/=(Fixed rhs)
+	{
+		*this = *this / rhs;
+		return *this;
+	}
+
+	friend constexpr Fixed operator+(Fixed lhs, Fixed rhs)
+	{
+		return FromRaw(lhs.raw + rhs.raw);
+	}
+
+	friend constexpr Fixed operator-(Fixed lhs, Fixed rhs)
+	{
+		return FromRaw(lhs.raw - rhs.raw);
+	}
+
+	friend constexpr Fixed operator*(Fixed lhs, Fixed rhs)
+	{
+		return FromRaw(static_cast<int32_t>((static_cast<int64_t>(lhs.raw) * rhs.raw) / 65536));
+	}
+
+	friend constexpr Fixed operator/(Fixed lhs, Fixed rhs)
+	{
+		return FromRaw(static_cast<int32_t>((static_cast<int64_t>(lhs.raw) * 65536) / rhs.raw));
+	}
+
+	friend constexpr bool operator==(Fixed lhs, Fixed rhs) { return lhs.raw == rhs.raw; }
+	friend constexpr bool operator!=(Fixed lhs, Fixed rhs) { return lhs.raw != rhs.raw; }
+	friend constexpr bool operator<(Fixed lhs, Fixed rhs) { return lhs.raw < rhs.raw; }
+	friend constexpr bool operator>(Fixed lhs, Fixed rhs) { return lhs.raw > rhs.raw; }
+	friend constexpr bool operator<=(Fixed lhs, Fixed rhs) { return lhs.raw <= rhs.raw; }
+	friend constexpr bool operator>=(Fixed lhs, Fixed rhs) { return lhs.raw >= rhs.raw; }
+};
@@ -0,0 +1,630 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "ecs.h"
+
+// Game rules shared by the SDL front end and headless tools. Nothing in here
+// may depend on SDL so matches can be simulated without a window.
+
+// Positions, velocities and times are Scalar. Building with
+// -DFIXED_POINT_PHYSICS makes that Q16.16 fixed point, so a match played from
+// the same inputs ends in the same bits everywhere (lockstep, replays).
+#ifdef FIXED_POINT_PHYSICS
+#include "fixed.h"
+typedef Fixed Scalar;
+#else
+typedef float Scalar;
+#endif
+
+static_assert(sizeof(Scalar) == sizeof(uint32_t), "Checksum hashes Scalars as 32 bit words");
+
+const int WIDTH = 1080, HEIGHT = 720;
+const int BALL_WIDTH = 45, BALL_HEIGHT = 45;
+const int PADDLE_WIDTH = 35, PADDLE_HEIGHT = 45;
+const Scalar PADDLE_SPEED = 1.0f;
+const Scalar BALL_SPEED = 0.6f;
+const float MATCH_TIME = 90000.0f; // 90 seconds in milliseconds
+const float TICK_MS = 8.0f;        // fixed step of networked, replayed and headless matches
+const int MAX_TEAM_SIZE = 11;
+const int FORMATION_COLUMNS = 4; // kickoff lines per team, 80 px apart
+
+// Tunables a match is played with. Defaults are the shipped game.
+struct Rules
+{
+	Scalar ballSpeed = BALL_SPEED;
+	Scalar paddleSpeed = PADDLE_SPEED;
+	Scalar paddleHeight = PADDLE_HEIGHT;
+	float matchTime = MATCH_TIME;
+	int teamSize = 2; // paddles per side, 1 to MAX_TEAM_SIZE
+};
+
+inline int TeamSizeOf(Rules const &rules)
+{
+	return rules.teamSize < 1 ? 1 : rules.teamSize > MAX_TEAM_SIZE ? MAX_TEAM_SIZE : rules.teamSize;
+}
+
+enum Buttons
+{
+	PaddleOneUp = 0,
+	PaddleOneDown,
+	PaddleTwoUp,
+	PaddleTwoDown,
+};
+
+// One player's input for one tick, as it travels over the network or sits in
+// a replay. Switch and restart are presses, not held keys. The top four
+// bits pick a paddle directly: 0 leaves the selection alone, k selects the
+// team's paddle k - 1 and INPUT_SELECT_NEAREST the one closest to the ball.
+enum InputBits : uint8_t
+{
+	InputUp = 1,
+	InputDown = 2,
+	InputSwitch = 4,
+	InputRestart = 8
+};
+
+const int INPUT_SELECT_SHIFT = 4;
+const uint8_t INPUT_SELECT_NEAREST = 15;
+
+static_assert(MAX_TEAM_SIZE < INPUT_SELECT_NEAREST, "every paddle needs a select code");
+
+inline uint8_t InputSelect(int paddle)
+{
+	return static_cast<uint8_t>((paddle + 1) << INPUT_SELECT_SHIFT);
+}
+
+enum class Team
+{
+	One, // Blue
+	Two  // Red
+};
+
+enum class CollisionType
+{
+	None,
+	Top,
+	Middle,
+	Bottom,
+	Left,
+	Right
+};
+
+enum class MatchEvent
+{
+	None,
+	PaddleHit,
+	WallBounce,
+	GoalOne, // Blue scored
+	GoalTwo  // Red scored
+};
+
+struct Contact
+{
+	CollisionType type;
+	Scalar penetration;
+};
+
+class Vec2
+{
+public:
+	Scalar x, y;
+	Vec2() : x(0.0f), y(0.0f) {}
+
+	Vec2(Scalar x, Scalar y) : x(x), y(y) {}
+
+	Vec2 operator+(Vec2 const &rhs) const
+	{
+		return Vec2(x + rhs.x, y + rhs.y);
+	}
+
+	Vec2 &operator+=(Vec2 const &rhs)
+	{
+		x += rhs.x;
+		y += rhs.y;
+
+		return *this;
+	}
+
+	Vec2 operator*(Scalar rhs) const
+	{
+		return Vec2(x * rhs, y * rhs);
+	}
+};
+
+// Components. A Transform is the top left corner of the entity's Collider.
+struct Transform : Vec2
+{
+	Transform() = default;
+	Transform(Vec2 position) : Vec2(position) {}
+};
+
+struct Velocity : Vec2
+{
+	Velocity() = default;
+	Velocity(Vec2 velocity) : Vec2(velocity) {}
+};
+
+struct Collider
+{
+	Scalar width;
+	Scalar height;
+};
+
+enum class SpriteId : uint8_t
+{
+	Ball,
+	Blue,
+	Red
+};
+
+// Team is a component as well: which side a paddle plays for.
+
+const int MAX_BALLS = 1;
+const int MAX_PADDLES = 2 * MAX_TEAM_SIZE;
+
+typedef Archetype<MAX_BALLS, Transform, Velocity, Collider, SpriteId> BallArchetype;
+typedef Archetype<MAX_PADDLES, Transform, Velocity, Collider, SpriteId, Team> PaddleArchetype;
+
+inline Scalar Abs(Scalar value)
+{
+	return value < 0 ? -value : value;
+}
+
+// Where a team's paddle k lines up at kickoff. Paddles fill the columns in
+// turn, starting at the team's own goal, and each column spreads its paddles
+// evenly down the field.
+inline Vec2 FormationSpot(Team team, int k, int teamSize, Scalar paddleHeight)
+{
+	int columns = teamSize < FORMATION_COLUMNS ? teamSize : FORMATION_COLUMNS;
+	int column = k % columns;
+	int inColumn = (teamSize - column + columns - 1) / columns;
+	int place = k / columns;
+
+	Scalar x = team == Team::One ? 80.0f * (column + 1) : WIDTH - 80.0f * (column + 1);
+	Scalar y = Scalar(HEIGHT * (place + 1) / (inColumn + 1.0f)) - (paddleHeight / 2.0f);
+	return Vec2(x, y);
+}
+
+// Systems. Each takes whole component arrays and knows nothing about which
+// entity is which.
+
+inline void MoveSystem(Transform *transform, Velocity const *velocity, int count, Scalar dt)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		transform[i] += velocity[i] * dt;
+	}
+}
+
+// Keeps paddles between the top and bottom of the screen
+inline void ClampSystem(Transform *transform, Collider const *collider, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		if (transform[i].y < 0)
+		{
+			transform[i].y = 0;
+		}
+		else if (transform[i].y > (HEIGHT - collider[i].height))
+		{
+			transform[i].y = HEIGHT - collider[i].height;
+		}
+	}
+}
+
+// Helper Function
+inline Contact CheckPaddleCollision(Transform const &ball, Velocity const &ballVelocity, Collider const &ballBox,
+									Transform const &paddle, Collider const &paddleBox)
+{
+	Scalar ballLeft = ball.x;
+	Scalar ballRight = ball.x + ballBox.width;
+	Scalar ballTop = ball.y;
+	Scalar ballBottom = ball.y + ballBox.height;
+
+	Scalar paddleLeft = paddle.x;
+	Scalar paddleRight = paddle.x + paddleBox.width;
+	Scalar paddleTop = paddle.y;
+	Scalar paddleBottom = paddle.y + paddleBox.height;
+
+	Contact contact{};
+
+	if (ballLeft >= paddleRight)
+	{
+		return contact;
+	}
+
+	if (ballRight <= paddleLeft)
+	{
+		return contact;
+	}
+
+	if (ballTop >= paddleBottom)
+	{
+		return contact;
+	}
+
+	if (ballBottom <= paddleTop)
+	{
+		return contact;
+	}
+
+	Scalar paddleRangeUpper = paddleBottom - (2.0f * paddleBox.height / 3.0f);
+	Scalar paddleRangeMiddle = paddleBottom - (paddleBox.height / 3.0f);
+
+	if (ballVelocity.x < 0)
+	{
+		// Left paddle
+		contact.penetration = paddleRight - ballLeft;
+	}
+	else if (ballVelocity.x > 0)
+	{
+		// Right paddle
+		contact.penetration = paddleLeft - ballRight;
+	}
+
+	if ((ballBottom > paddleTop) && (ballBottom < paddleRangeUpper))
+	{
+		contact.type = CollisionType::Top;
+	}
+	else if ((ballBottom > paddleRangeUpper) && (ballBottom < paddleRangeMiddle))
+	{
+		contact.type = CollisionType::Middle;
+	}
+	else
+	{
+		contact.type = CollisionType::Bottom;
+	}
+
+	return contact;
+}
+
+inline Contact CheckWallCollision(Transform const &ball, Collider const &ballBox)
+{
+	Scalar ballLeft = ball.x;
+	Scalar ballRight = ball.x + ballBox.width;
+	Scalar ballTop = ball.y;
+	Scalar ballBottom = ball.y + ballBox.height;
+
+	Contact contact{};
+
+	if (ballLeft < 0)
+	{
+		contact.type = CollisionType::Left;
+	}
+	else if (ballRight > WIDTH)
+	{
+		contact.type = CollisionType::Right;
+	}
+	else if (ballTop < 0)
+	{
+		contact.type = CollisionType::Top;
+		contact.penetration = -ballTop;
+	}
+	else if (ballBottom > HEIGHT)
+	{
+		contact.type = CollisionType::Bottom;
+		contact.penetration = HEIGHT - ballBottom;
+	}
+
+	return contact;
+}
+
+inline void CollideWithPaddle(Transform &ball, Velocity &velocity, Contact const &contact, Rules const &rules)
+{
+	ball.x += contact.penetration;
+	velocity.x = -velocity.x;
+
+	if (contact.type == CollisionType::Top)
+	{
+		velocity.y = -.75f * rules.ballSpeed;
+	}
+	else if (contact.type == CollisionType::Bottom)
+	{
+		velocity.y = 0.75f * rules.ballSpeed;
+	}
+}
+
+inline void CollideWithWall(Transform &ball, Velocity &velocity, Contact const &contact, Rules const &rules)
+{
+	if ((contact.type == CollisionType::Top) || (contact.type == CollisionType::Bottom))
+	{
+		ball.y += contact.penetration;
+		velocity.y = -velocity.y;
+	}
+	else if (contact.type == CollisionType::Left)
+	{
+		ball.x = WIDTH / 2.0f;
+		ball.y = HEIGHT / 2.0f;
+		velocity.x = rules.ballSpeed;
+		velocity.y = 0.75f * rules.ballSpeed;
+	}
+	else if (contact.type == CollisionType::Right)
+	{
+		ball.x = WIDTH / 2.0f;
+		ball.y = HEIGHT / 2.0f;
+		velocity.x = -rules.ballSpeed;
+		velocity.y = 0.75f * rules.ballSpeed;
+	}
+}
+
+// Full state of one match. Plain data only (no pointers), so a match can be
+// copied around freely and many of them can run side by side.
+class Match
+{
+public:
+	Match(Rules rules = Rules())
+		: rules(rules)
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		balls.Clear();
+		balls.Add(Vec2((WIDTH / 2.0f) - (BALL_WIDTH / 2.0f), (HEIGHT / 2.0f) - (BALL_WIDTH / 2.0f)),
+				  Vec2(rules.ballSpeed, 0.0f), Collider{BALL_WIDTH, BALL_HEIGHT}, SpriteId::Ball);
+
+		// Blue's paddles, then Red's, each team contiguous
+		int teamSize = TeamSize();
+		Collider box{PADDLE_WIDTH, rules.paddleHeight};
+		paddles.Clear();
+		for (int k = 0; k < teamSize; ++k)
+		{
+			paddles.Add(FormationSpot(Team::One, k, teamSize, rules.paddleHeight), Vec2(), box, SpriteId::Blue, Team::One);
+		}
+		for (int k = 0; k < teamSize; ++k)
+		{
+			paddles.Add(FormationSpot(Team::Two, k, teamSize, rules.paddleHeight), Vec2(), box, SpriteId::Red, Team::Two);
+		}
+
+		currentOne = FirstPaddle(Team::One);
+		currentTwo = FirstPaddle(Team::Two);
+		playerOneScore = 0;
+		playerTwoScore = 0;
+		totalTime = 0.0f;
+		finished = false;
+	}
+
+	int TeamSize() const
+	{
+		return TeamSizeOf(rules);
+	}
+
+	// Paddle row of a team's paddle 0
+	int FirstPaddle(Team team) const
+	{
+		return team == Team::One ? 0 : TeamSize();
+	}
+
+	// Row of the team's selected paddle
+	int Current(Team team) const
+	{
+		return team == Team::One ? currentOne : currentTwo;
+	}
+
+	// The team's paddle k, counted from its own goal line outwards
+	void Select(Team team, int k)
+	{
+		int row = FirstPaddle(team) + (k < 0 ? 0 : k >= TeamSize() ? TeamSize() - 1 : k);
+		(team == Team::One ? currentOne : currentTwo) = row;
+	}
+
+	// Round robin through the team
+	void Switch(Team team)
+	{
+		Select(team, (Current(team) - FirstPaddle(team) + 1) % TeamSize());
+	}
+
+	// The team's paddle whose centre is closest to the ball's, in steps
+	// along x plus steps along y. Ties keep the lower paddle.
+	void SelectNearest(Team team)
+	{
+		Transform const &ball = balls.Get<Transform>(0);
+		Collider const &ballBox = balls.Get<Collider>(0);
+		Transform const *paddleAt = paddles.Get<Transform>();
+		Collider const *paddleBox = paddles.Get<Collider>();
+
+		int first = FirstPaddle(team);
+		int best = first;
+		Scalar bestDistance = 0;
+		for (int row = first; row < first + TeamSize(); ++row)
+		{
+			Scalar dx = paddleAt[row].x + paddleBox[row].width / 2 - ball.x - ballBox.width / 2;
+			Scalar dy = paddleAt[row].y + paddleBox[row].height / 2 - ball.y - ballBox.height / 2;
+			Scalar distance = Abs(dx) + Abs(dy);
+			if (row == first || distance < bestDistance)
+			{
+				best = row;
+				bestDistance = distance;
+			}
+		}
+		(team == Team::One ? currentOne : currentTwo) = best;
+	}
+
+	// The switch and select parts of one player's input
+	void ApplySelection(Team team, uint8_t input)
+	{
+		if (input & InputSwitch)
+		{
+			Switch(team);
+		}
+
+		int select = input >> INPUT_SELECT_SHIFT;
+		if (select == INPUT_SELECT_NEAREST)
+		{
+			SelectNearest(team);
+		}
+		else if (select != 0)
+		{
+			Select(team, select - 1);
+		}
+	}
+
+	// Only the selected paddle of each team follows the buttons; the other one
+	// keeps whatever velocity it had when the player switched away from it.
+	void ApplyButtons(bool const buttons[4])
+	{
+		Velocity *velocity = paddles.Get<Velocity>();
+
+		if (buttons[Buttons::PaddleOneUp])
+		{
+			velocity[currentOne].y = -rules.paddleSpeed;
+		}
+		else if (buttons[Buttons::PaddleOneDown])
+		{
+			velocity[currentOne].y = rules.paddleSpeed;
+		}
+		else
+		{
+			velocity[currentOne].y = 0.0f;
+		}
+
+		if (buttons[Buttons::PaddleTwoUp])
+		{
+			velocity[currentTwo].y = -rules.paddleSpeed;
+		}
+		else if (buttons[Buttons::PaddleTwoDown])
+		{
+			velocity[currentTwo].y = rules.paddleSpeed;
+		}
+		else
+		{
+			velocity[currentTwo].y = 0.0f;
+		}
+	}
+
+	// One fixed step driven by packed inputs
+	MatchEvent Tick(uint8_t inputOne, uint8_t inputTwo)
+	{
+		if ((inputOne | inputTwo) & InputRestart)
+		{
+			Reset();
+		}
+		ApplySelection(Team::One, inputOne);
+		ApplySelection(Team::Two, inputTwo);
+
+		bool buttons[4] = {
+			(inputOne & InputUp) != 0, (inputOne & InputDown) != 0,
+			(inputTwo & InputUp) != 0, (inputTwo & InputDown) != 0};
+		ApplyButtons(buttons);
+
+		return Update(TICK_MS);
+	}
+
+	// Advance the match by dt milliseconds and report what the ball did.
+	MatchEvent Update(Scalar dt)
+	{
+		if (finished)
+		{
+			return MatchEvent::None;
+		}
+
+		MoveSystem(paddles.Get<Transform>(), paddles.Get<Velocity>(), paddles.Count(), dt);
+		ClampSystem(paddles.Get<Transform>(), paddles.Get<Collider>(), paddles.Count());
+		MoveSystem(balls.Get<Transform>(), balls.Get<Velocity>(), balls.Count(), dt);
+
+		MatchEvent event = MatchEvent::None;
+		for (int ball = 0; ball < balls.Count(); ++ball)
+		{
+			MatchEvent what = CollideBall(ball);
+			event = what != MatchEvent::None ? what : event;
+		}
+
+		totalTime += static_cast<float>(dt);
+		if (totalTime >= rules.matchTime)
+		{
+			finished = true;
+		}
+
+		return event;
+	}
+
+	// Hash of everything the simulation depends on. Two matches fed the same
+	// inputs must agree on it tick for tick; in fixed point that holds across
+	// machines as well.
+	uint32_t Checksum() const
+	{
+		uint32_t hash = 2166136261U;
+		auto mix = [&hash](Scalar value)
+		{
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			hash = (hash ^ bits) * 16777619U;
+		};
+
+		balls.Each<Transform, Velocity>([&mix](Transform const &position, Velocity const &velocity)
+		{
+			mix(position.x);
+			mix(position.y);
+			mix(velocity.x);
+			mix(velocity.y);
+		});
+		paddles.Each<Transform, Velocity>([&mix](Transform const &position, Velocity const &velocity)
+		{
+			mix(position.y);
+			mix(velocity.y);
+		});
+		hash = (hash ^ static_cast<uint32_t>(currentOne | (currentTwo << 8))) * 16777619U;
+		hash = (hash ^ static_cast<uint32_t>(playerOneScore | (playerTwoScore << 16))) * 16777619U;
+
+		return hash;
+	}
+
+	// Every entity that has the wanted components, balls first
+	template <typename... Wanted, typename Body>
+	void Each(Body body) const
+	{
+		EachEntity<Wanted...>(body, balls, paddles);
+	}
+
+	// Ball against the paddles, first hit wins, then against the walls
+	MatchEvent CollideBall(int ball)
+	{
+		Transform &position = balls.Get<Transform>(ball);
+		Velocity &velocity = balls.Get<Velocity>(ball);
+		Collider const &box = balls.Get<Collider>(ball);
+
+		Transform const *paddleAt = paddles.Get<Transform>();
+		Collider const *paddleBox = paddles.Get<Collider>();
+		for (int paddle = 0; paddle < paddles.Count(); ++paddle)
+		{
+			Contact contact = CheckPaddleCollision(position, velocity, box, paddleAt[paddle], paddleBox[paddle]);
+			if (contact.type != CollisionType::None)
+			{
+				CollideWithPaddle(position, velocity, contact, rules);
+				return MatchEvent::PaddleHit;
+			}
+		}
+
+		Contact contact = CheckWallCollision(position, box);
+		if (contact.type == CollisionType::None)
+		{
+			return MatchEvent::None;
+		}
+
+		CollideWithWall(position, velocity, contact, rules);
+		if (contact.type == CollisionType::Left)
+		{
+			++playerTwoScore;
+			return MatchEvent::GoalTwo;
+		}
+		if (contact.type == CollisionType::Right)
+		{
+			++playerOneScore;
+			return MatchEvent::GoalOne;
+		}
+		return MatchEvent::WallBounce;
+	}
+
+	Rules rules;
+	BallArchetype balls;
+	PaddleArchetype paddles; // Blue rows first, then Red
+	int currentOne; // paddle rows
+	int currentTwo;
+	int playerOneScore;
+	int playerTwoScore;
+	float totalTime;
+	bool finished;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Microsecond samples counted into 1 us buckets, so percentiles of millions
+// of ticks or packets cost a fixed amount of memory. Anything past the last
+// bucket is counted there; Max() still reports the true value.
+class Histogram
+{
+public:
+	explicit Histogram(int maxUs = 100000)
+		: counts(maxUs + 1)
+	{
+	}
+
+	void Add(double us)
+	{
+		int bucket = us < 0.0 ? 0 : us >= counts.size() - 1 ? static_cast<int>(counts.size()) - 1 : static_cast<int>(us);
+		++counts[bucket];
+		++count;
+		sum += us;
+		max = us > max ? us : max;
+	}
+
+	// p in [0, 1]
+	double Percentile(double p) const
+	{
+		uint64_t target = static_cast<uint64_t>(p * count);
+		uint64_t seen = 0;
+		for (size_t bucket = 0; bucket < counts.size(); ++bucket)
+		{
+			seen += counts[bucket];
+			if (seen > target)
+			{
+				return static_cast<double>(bucket);
+			}
+		}
+		return max;
+	}
+
+	double Mean() const { return count ? sum / count : 0.0; }
+	double Max() const { return max; }
+	uint64_t Count() const { return count; }
+
+	void Clear()
+	{
+		counts.assign(counts.size(), 0);
+		count = 0;
+		sum = 0.0;
+		max = 0.0;
+	}
+
+private:
+	std::vector<uint64_t> counts;
+	uint64_t count = 0;
+	double sum = 0.0;
+	double max = 0.0;
+};
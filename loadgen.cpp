@@ -0,0 +1,296 @@
+// Fills a match server with bot players and measures it from the client
+// side: how evenly state updates arrive and how many bytes a match costs.
+// Each bot has its own UDP socket, so the server sees them as separate
+// players, and plays with DecideAi on the state it is sent.
+//
+//   server --duration 30 &
+//   loadgen --matches 1000 --duration 25
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "ai.h"
+#include "histogram.h"
+#include "net.h"
+#include "protocol.h"
+
+const double JOIN_RETRY_MS = 1000.0;
+const double STATE_TIMEOUT_MS = 3000.0; // rejoin when the server goes quiet
+
+static double NowMs()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Bot
+{
+	std::unique_ptr<UdpSocket> socket;
+	AiParams params;
+	Team team = Team::One;
+	bool seated = false;
+	Match view;
+	SnapshotHistory received;
+	uint32_t lastTick = 0; // newest state, acknowledged with every input
+	int selected = -1;     // own team's paddle in the newest state
+	double lastState = 0.0;
+	double joinSent = -JOIN_RETRY_MS;
+};
+
+struct Totals
+{
+	uint64_t states = 0;
+	uint64_t stateBytes = 0;
+	uint64_t bytesIn = 0;
+	uint64_t bytesOut = 0;
+	uint64_t finished = 0;
+	uint64_t rejoins = 0;
+	uint64_t paddleChanges = 0; // a bot's team moved to another paddle
+	Histogram jitter;
+};
+
+static void Send(Bot &bot, Endpoint const &server, uint8_t const *packet, int size, Totals &totals)
+{
+	bot.socket->Send(server, packet, size);
+	totals.bytesOut += size;
+}
+
+static void Join(Bot &bot, Endpoint const &server, double now, Totals &totals)
+{
+	uint8_t packet[PACKET_HEADER_SIZE];
+	PutHeader(packet, PacketType::Join);
+	Send(bot, server, packet, sizeof(packet), totals);
+	bot.seated = false;
+	bot.lastTick = 0;
+	bot.joinSent = now;
+}
+
+static void Receive(Bot &bot, SnapshotCodec const &codec, Endpoint const &server, double now, Totals &totals)
+{
+	uint8_t packet[64];
+	Endpoint from;
+	int size;
+
+	while ((size = bot.socket->Receive(packet, sizeof(packet), from)) >= 0)
+	{
+		totals.bytesIn += size;
+		uint8_t type = ReadHeader(packet, size);
+
+		if (type == static_cast<uint8_t>(PacketType::Welcome) && size >= WELCOME_SIZE)
+		{
+			bot.team = packet[PACKET_HEADER_SIZE] == 0 ? Team::One : Team::Two;
+			bot.seated = true;
+			bot.lastState = now;
+			bot.selected = -1;
+			bot.received.Clear();
+			continue;
+		}
+
+		Snapshot snapshot;
+		if (!bot.seated || type != static_cast<uint8_t>(PacketType::State) ||
+			!codec.Decode(packet + PACKET_HEADER_SIZE, size - PACKET_HEADER_SIZE, bot.received, snapshot) ||
+			snapshot.tick <= bot.lastTick)
+		{
+			continue;
+		}
+		bot.received.Add(snapshot);
+		codec.Apply(snapshot, bot.view);
+		uint32_t tick = snapshot.tick;
+		++totals.states;
+		totals.stateBytes += size;
+
+		// Deviation from the spacing the server's tick numbers promise
+		if (bot.lastTick > 0 && tick > bot.lastTick)
+		{
+			double expected = (tick - bot.lastTick) * static_cast<double>(TICK_MS);
+			double actual = now - bot.lastState;
+			totals.jitter.Add((actual > expected ? actual - expected : expected - actual) * 1000.0);
+		}
+		bot.lastTick = tick;
+		bot.lastState = now;
+
+		// The bots pick paddles with the select bits, so with more than one
+		// paddle a side this stays at zero only if the server drops them
+		int selected = bot.view.Current(bot.team);
+		totals.paddleChanges += bot.selected >= 0 && selected != bot.selected;
+		bot.selected = selected;
+
+		if (bot.view.finished)
+		{
+			// Team One counts the match so each is counted once
+			totals.finished += bot.team == Team::One;
+			++totals.rejoins;
+			Join(bot, server, now, totals);
+			continue;
+		}
+
+		uint8_t input[INPUT_SIZE];
+		PutHeader(input, PacketType::Input);
+		input[PACKET_HEADER_SIZE] = AiInput(DecideAi(bot.view, bot.team, bot.params));
+		Put32(input + PACKET_HEADER_SIZE + 1, bot.lastTick);
+		Send(bot, server, input, sizeof(input), totals);
+	}
+}
+
+static void Report(Totals const &totals, std::vector<Bot> const &bots, double seconds)
+{
+	int seated = 0;
+	for (Bot const &bot : bots)
+	{
+		seated += bot.seated;
+	}
+
+	int matches = static_cast<int>(bots.size()) / 2;
+	double perMatch = matches > 0 && seconds > 0.0 ? 1.0 / (matches * seconds) : 0.0;
+	std::printf("%d/%d bots seated | %llu states of %.1f B avg, arrival jitter p50 %.0f us p99 %.0f us max %.0f us | "
+				"per match %.0f B/s in %.0f B/s out | %llu paddle changes | %llu finished, %llu rejoins\n",
+				seated, matches * 2, static_cast<unsigned long long>(totals.states),
+				totals.states ? static_cast<double>(totals.stateBytes) / totals.states : 0.0,
+				totals.jitter.Percentile(0.5), totals.jitter.Percentile(0.99), totals.jitter.Max(),
+				totals.bytesIn * perMatch, totals.bytesOut * perMatch,
+				static_cast<unsigned long long>(totals.paddleChanges),
+				static_cast<unsigned long long>(totals.finished),
+				static_cast<unsigned long long>(totals.rejoins));
+	std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string address = "127.0.0.1";
+	int port = SERVER_PORT;
+	int matches = 100;
+	double duration = 10.0;
+	double report = 5.0;
+	float error = 40.0f;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		double value = std::atof(argv[i + 1]);
+		if (flag == "--server")
+		{
+			address = argv[i + 1];
+		}
+		else if (flag == "--port")
+		{
+			port = static_cast<int>(value);
+		}
+		else if (flag == "--matches")
+		{
+			matches = static_cast<int>(value);
+		}
+		else if (flag == "--duration")
+		{
+			duration = value;
+		}
+		else if (flag == "--report")
+		{
+			report = value;
+		}
+		else if (flag == "--error")
+		{
+			error = static_cast<float>(value);
+		}
+		else
+		{
+			std::printf("Usage: loadgen [--server HOST] [--port N] [--matches N] [--duration S] [--report S] [--error PX]\n");
+			return 1;
+		}
+	}
+
+	Endpoint server = Endpoint::Resolve(address, static_cast<uint16_t>(port));
+	if (!server.valid)
+	{
+		std::printf("cannot resolve %s\n", address.c_str());
+		return 1;
+	}
+
+	// Two sockets per match plus a few spare
+	rlimit files{};
+	getrlimit(RLIMIT_NOFILE, &files);
+	rlim_t wanted = static_cast<rlim_t>(matches) * 2 + 16;
+	if (files.rlim_cur < wanted)
+	{
+		files.rlim_cur = wanted < files.rlim_max ? wanted : files.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &files);
+	}
+
+	int epoll = epoll_create1(0);
+	std::vector<Bot> bots(matches * 2);
+	for (size_t i = 0; i < bots.size(); ++i)
+	{
+		Bot &bot = bots[i];
+		bot.socket.reset(new UdpSocket());
+		if (!bot.socket->IsOpen() || !bot.socket->Bind(0))
+		{
+			std::printf("could only open %zu sockets\n", i);
+			return 1;
+		}
+		bot.params.error = error;
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.u32 = static_cast<uint32_t>(i);
+		epoll_ctl(epoll, EPOLL_CTL_ADD, bot.socket->Handle(), &event);
+	}
+
+	SnapshotCodec codec;
+	Totals totals;
+	double start = NowMs();
+	double reportStart = start;
+	double nextReport = start + report * 1000.0;
+	double nextCheck = start;
+	std::vector<epoll_event> events(256);
+
+	while (NowMs() - start < duration * 1000.0)
+	{
+		int ready = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), 10);
+		double now = NowMs();
+		for (int e = 0; e < ready; ++e)
+		{
+			Receive(bots[events[e].data.u32], codec, server, now, totals);
+		}
+
+		if (now >= nextCheck)
+		{
+			for (Bot &bot : bots)
+			{
+				if (!bot.seated && now - bot.joinSent >= JOIN_RETRY_MS)
+				{
+					Join(bot, server, now, totals);
+				}
+				else if (bot.seated && now - bot.lastState >= STATE_TIMEOUT_MS)
+				{
+					++totals.rejoins;
+					Join(bot, server, now, totals);
+				}
+			}
+			nextCheck = now + 100.0;
+		}
+
+		if (now >= nextReport)
+		{
+			Report(totals, bots, (now - reportStart) / 1000.0);
+			totals = Totals();
+			reportStart = now;
+			nextReport = now + report * 1000.0;
+		}
+	}
+
+	if (totals.states > 0)
+	{
+		Report(totals, bots, (NowMs() - reportStart) / 1000.0);
+	}
+
+	close(epoll);
+	return EXIT_SUCCESS;
+}
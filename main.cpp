@@ -1,11 +1,37 @@
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_ttf.h>
 #include <sstream>
 
+#include "game.h"
+#include "ai.h"
+#include "arena.h"
+#include "audio.h"
+#include "botlink.h"
+#include "capture.h"
+#include "dirty.h"
+#include "net.h"
+#include "pack.h"
+#include "particles.h"
+#include "pool.h"
+#include "rollback.h"
+#include "replay.h"
+#include "spectator.h"
+#include "watch.h"
+
+#ifdef EMBED_ASSETS
+#include "embedded_assets.h"
+#endif
+
 // template< typename T >
 // std::string ToString( const T& var )
 // {
@@ -13,186 +39,288 @@
 //     oss << var;
 //     return var.str();
 // }
-const int WIDTH = 1080, HEIGHT = 720;
-const int BALL_WIDTH = 45, BALL_HEIGHT = 45;
-const int PADDLE_WIDTH = 35, PADDLE_HEIGHT = 45;
-const float PADDLE_SPEED = 1.0f;
-const float BALL_SPEED = 0.6f;
-
-enum Buttons
-{
-	PaddleOneUp = 0,
-	PaddleOneDown,
-	PaddleTwoUp,
-	PaddleTwoDown,
-};
-
-enum class CollisionType
-{
-	None,
-	Top,
-	Middle,
-	Bottom,
-	Left,
-	Right
-};
-
-struct Contact
-{
-	CollisionType type;
-	float penetration;
-};
 
-class Vec2
+// Where asset files come from, first match wins: the override directory
+// (--mods DIR), copies built into the executable (make embeds them), then
+// assets/ next to the executable, whatever the working directory is.
+class AssetFiles
 {
 public:
-	float x, y;
-	Vec2() : x(0.0f), y(0.0f) {}
+	explicit AssetFiles(std::string const &overrideDir)
+		: overrideDir(overrideDir.empty() || overrideDir.back() == '/' ? overrideDir : overrideDir + "/")
+	{
+		char *base = SDL_GetBasePath();
+		baseDir = std::string(base ? base : "./") + "assets/";
+		SDL_free(base);
+	}
 
-	Vec2(float x, float y) : x(x), y(y) {}
+	// The override directory has its own copy of name
+	bool Overridden(std::string const &name) const
+	{
+		return !overrideDir.empty() && Exists(overrideDir + name);
+	}
 
-	Vec2 operator+(Vec2 const &rhs)
+	EmbeddedFile const *Embedded(std::string const &name) const
 	{
-		return Vec2(x + rhs.x, y + rhs.y);
+#ifdef EMBED_ASSETS
+		for (EmbeddedFile const *file = EMBEDDED_FILES; file->name; ++file)
+		{
+			if (name == file->name)
+			{
+				return file;
+			}
+		}
+#else
+		(void)name;
+#endif
+		return nullptr;
 	}
 
-	Vec2 &operator+=(Vec2 const &rhs)
+	// Null when nothing has the file
+	SDL_RWops *Open(std::string const &name) const
 	{
-		x += rhs.x;
-		y += rhs.y;
+		if (Overridden(name))
+		{
+			return SDL_RWFromFile((overrideDir + name).c_str(), "rb");
+		}
+		if (EmbeddedFile const *file = Embedded(name))
+		{
+			return SDL_RWFromConstMem(file->data, static_cast<int>(file->size));
+		}
+		return SDL_RWFromFile((baseDir + name).c_str(), "rb");
+	}
 
-		return *this;
+	// Where name would be read from disk, empty when it is built in and
+	// not overridden
+	std::string Path(std::string const &name) const
+	{
+		if (Overridden(name))
+		{
+			return overrideDir + name;
+		}
+		return Embedded(name) ? "" : baseDir + name;
 	}
 
-	Vec2 operator*(float rhs)
+	static bool Exists(std::string const &path)
 	{
-		return Vec2(x * rhs, y * rhs);
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (file)
+		{
+			std::fclose(file);
+		}
+		return file != nullptr;
 	}
+
+private:
+	std::string overrideDir;
+	std::string baseDir;
 };
 
-class Ball
+// Images named relative to the assets directory. Ones the asset pack
+// has are copied out of it unless they are overridden; the rest are decoded
+// from their PNGs (see AssetFiles) on a pool of threads, started before the
+// window exists so decoding overlaps creating the window and renderer.
+// Textures belong to the renderer and are made on the main thread from the
+// decoded surfaces.
+class AssetLoader
 {
 public:
-	Vec2 position;
-	Vec2 velocity;
-	SDL_Rect rect{};
-	SDL_Texture *texture;
-
-	Ball(Vec2 position, Vec2 velocity, SDL_Renderer *renderer)
-		: position(position), velocity(velocity)
+	AssetLoader(AssetPack const &pack, AssetFiles const &files) : pack(pack), files(files)
 	{
-		rect.x = static_cast<int>(position.x);
-		rect.y = static_cast<int>(position.y);
-		rect.w = BALL_WIDTH;
-		rect.h = BALL_HEIGHT;
+	}
 
-		SDL_Surface *imageSurface = IMG_Load("./assets/ball.png"); // Replace "image.png" with the path to your PNG image
-		if (imageSurface == nullptr)
+	~AssetLoader()
+	{
+		Wait();
+		for (Image &image : images)
 		{
-			// Handle error loading image
+			SDL_FreeSurface(image.surface);
 		}
-
-		texture = SDL_CreateTextureFromSurface(renderer, imageSurface);
-		SDL_FreeSurface(imageSurface);
 	}
 
-	void Update(float dt)
-	{
-		position += velocity * dt;
-	}
+	AssetLoader(AssetLoader const &) = delete;
+	AssetLoader &operator=(AssetLoader const &) = delete;
 
-	void Draw(SDL_Renderer *renderer)
+	void Start(std::vector<std::string> const &names)
 	{
-		rect.x = static_cast<int>(position.x);
-		rect.y = static_cast<int>(position.y);
+		for (std::string const &name : names)
+		{
+			if (files.Overridden(name) || !pack.Find(name))
+			{
+				images.push_back(Image{name, nullptr, 0.0f, ""});
+			}
+		}
+		if (images.empty())
+		{
+			return;
+		}
 
-		SDL_RenderCopy(renderer, texture, nullptr, &rect);
+		// Codecs are set up lazily; do it once here rather than racing
+		IMG_Init(IMG_INIT_PNG);
+		int cores = static_cast<int>(std::thread::hardware_concurrency());
+		threads = cores < 1 ? 1 : cores < static_cast<int>(images.size()) ? cores : static_cast<int>(images.size());
+		start = std::chrono::steady_clock::now();
+		decoder = std::thread([this]()
+		{
+			WorkerPool pool(threads);
+			std::atomic<int> next{0};
+			pool.Run([&](int)
+			{
+				for (int i = next++; i < static_cast<int>(images.size()); i = next++)
+				{
+					auto begin = std::chrono::steady_clock::now();
+					SDL_RWops *source = files.Open(images[i].name);
+					images[i].surface = source ? IMG_Load_RW(source, 1) : nullptr;
+					if (!images[i].surface)
+					{
+						images[i].error = source ? IMG_GetError() : "not found"; // errors are per thread
+					}
+					images[i].decodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+				}
+			});
+			decodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		});
 	}
 
-	void CollideWithPaddle(Contact const &contact)
+	// Blocks until every image is decoded. Returns how long the caller was
+	// kept waiting.
+	float Wait()
 	{
-		position.x += contact.penetration;
-		velocity.x = -velocity.x;
-
-		if (contact.type == CollisionType::Top)
-		{
-			velocity.y = -.75f * BALL_SPEED;
-		}
-		else if (contact.type == CollisionType::Bottom)
+		auto begin = std::chrono::steady_clock::now();
+		if (decoder.joinable())
 		{
-			velocity.y = 0.75f * BALL_SPEED;
+			decoder.join();
 		}
+		return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
 	}
 
-	void CollideWithWall(Contact const &contact)
+	SDL_Texture *Texture(SDL_Renderer *renderer, std::string const &name)
 	{
-		if ((contact.type == CollisionType::Top) || (contact.type == CollisionType::Bottom))
+		Wait();
+		for (Image &image : images)
 		{
-			position.y += contact.penetration;
-			velocity.y = -velocity.y;
+			if (image.name == name && image.surface)
+			{
+				return SDL_CreateTextureFromSurface(renderer, image.surface);
+			}
+			if (image.name == name)
+			{
+				std::cout << "Error: cannot load " << name << ": " << image.error << std::endl;
+				return nullptr;
+			}
 		}
-		else if (contact.type == CollisionType::Left)
+
+		PackEntry const *entry = pack.Find(name);
+		if (entry && entry->kind == PackKind::Image)
 		{
-			position.x = WIDTH / 2.0f;
-			position.y = HEIGHT / 2.0f;
-			velocity.x = BALL_SPEED;
-			velocity.y = 0.75f * BALL_SPEED;
+			SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+													 entry->width, entry->height);
+			SDL_UpdateTexture(texture, nullptr, pack.Data(*entry), entry->pitch);
+			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+			return texture;
 		}
-		else if (contact.type == CollisionType::Right)
+		std::cout << "Error: " << name << " was never loaded" << std::endl;
+		return nullptr;
+	}
+
+	// Wall time of the whole parallel decode, and the decode time of each
+	// image added up
+	float DecodeMs() const { return decodeMs; }
+	float DecodeSumMs() const
+	{
+		float sum = 0.0f;
+		for (Image const &image : images)
 		{
-			position.x = WIDTH / 2.0f;
-			position.y = HEIGHT / 2.0f;
-			velocity.x = -BALL_SPEED;
-			velocity.y = 0.75f * BALL_SPEED;
+			sum += image.decodeMs;
 		}
+		return sum;
 	}
+	int Threads() const { return threads; }
+	int DecodedCount() const { return static_cast<int>(images.size()); }
+
+private:
+	struct Image
+	{
+		std::string name;
+		SDL_Surface *surface;
+		float decodeMs;
+		std::string error;
+	};
+
+	AssetPack const &pack;
+	AssetFiles const &files;
+	std::vector<Image> images;
+	std::thread decoder;
+	std::chrono::steady_clock::time_point start;
+	float decodeMs = 0.0f;
+	int threads = 0;
 };
 
-class Paddle
+// Font from the asset pack, which must stay open as long as the font, or
+// from wherever AssetFiles finds it
+TTF_Font *LoadFont(AssetPack const &pack, AssetFiles const &files, std::string const &name, int size)
 {
-public:
-	Paddle(Vec2 position, Vec2 v, SDL_Renderer *renderer, std::string path)
-		: position(position), velocity(v)
+	PackEntry const *entry = pack.Find(name);
+	if (entry && !files.Overridden(name))
 	{
-		rect.x = static_cast<int>(position.x);
-		rect.y = static_cast<int>(position.y);
-		rect.w = PADDLE_WIDTH;
-		rect.h = PADDLE_HEIGHT;
-		const char * imgpath = path.c_str();
-		SDL_Surface *imageSurface = IMG_Load(imgpath); // Replace "image.png" with the path to your PNG image
-		if (imageSurface == nullptr)
+		return TTF_OpenFontRW(SDL_RWFromConstMem(pack.Data(*entry), static_cast<int>(entry->size)), 1, size);
+	}
+	SDL_RWops *source = files.Open(name);
+	return source ? TTF_OpenFontRW(source, 1, size) : nullptr;
+}
+
+// Replaces a synthesized effect with a WAV file when AssetFiles finds one
+void LoadSound(Mixer &mixer, AssetFiles const &files, Sound sound, std::string const &name)
+{
+	SDL_RWops *source = files.Open(name);
+	SDL_AudioSpec spec;
+	Uint8 *buffer = nullptr;
+	Uint32 length = 0;
+	if (!source || !SDL_LoadWAV_RW(source, 1, &spec, &buffer, &length))
+	{
+		return;
+	}
+
+	// To mono floats at the mixer's rate
+	SDL_AudioCVT convert;
+	if (SDL_BuildAudioCVT(&convert, spec.format, spec.channels, spec.freq, AUDIO_F32SYS, 1, AUDIO_RATE) >= 0)
+	{
+		std::vector<Uint8> work(static_cast<size_t>(length) * (convert.len_mult > 0 ? convert.len_mult : 1));
+		std::memcpy(work.data(), buffer, length);
+		convert.buf = work.data();
+		convert.len = static_cast<int>(length);
+		if (SDL_ConvertAudio(&convert) == 0)
 		{
-			// Handle error loading image
+			float const *samples = reinterpret_cast<float const *>(work.data());
+			mixer.Load(sound, std::vector<float>(samples, samples + convert.len_cvt / sizeof(float)));
 		}
+	}
+	SDL_FreeWAV(buffer);
+}
 
-		texture = SDL_CreateTextureFromSurface(renderer, imageSurface);
-		SDL_FreeSurface(imageSurface);
+class Sprite
+{
+public:
+	Sprite(SDL_Renderer *renderer, AssetLoader &assets, std::string name, int width, int height)
+	{
+		rect.w = width;
+		rect.h = height;
+		texture = assets.Texture(renderer, name);
 	}
 
-	void Draw(SDL_Renderer *renderer)
+	~Sprite()
 	{
-		rect.y = static_cast<int>(position.y);
-		SDL_RenderCopy(renderer, texture, nullptr, &rect);
+		SDL_DestroyTexture(texture);
 	}
 
-	void Update(float dt)
+	void Draw(SDL_Renderer *renderer, Vec2 position)
 	{
-		position += velocity * dt;
+		rect.x = static_cast<int>(position.x);
+		rect.y = static_cast<int>(position.y);
 
-		if (position.y < 0)
-		{
-			// Restrict to top of the screen
-			position.y = 0;
-		}
-		else if (position.y > (HEIGHT - PADDLE_HEIGHT))
-		{
-			// Restrict to bottom of the screen
-			position.y = HEIGHT - PADDLE_HEIGHT;
-		}
+		SDL_RenderCopy(renderer, texture, nullptr, &rect);
 	}
 
-	Vec2 position;
-	Vec2 velocity;
 	SDL_Rect rect{};
 	SDL_Texture *texture;
 };
@@ -200,10 +328,10 @@ public:
 class TextClass
 {
 public:
-	TextClass(Vec2 position, SDL_Renderer *renderer, TTF_Font *font, std::string initVal = "0")
-		: renderer(renderer), font(font)
+	TextClass(Vec2 position, SDL_Renderer *renderer, TTF_Font *font, char const *initVal = "0")
+		: renderer(renderer), font(font), shown(initVal)
 	{
-		surface = TTF_RenderText_Solid(font, initVal.c_str(), {0xFF, 0xFF, 0xFF, 0xFF});
+		surface = TTF_RenderText_Solid(font, initVal, {0xFF, 0xFF, 0xFF, 0xFF});
 		texture = SDL_CreateTextureFromSurface(renderer, surface);
 
 		int width, height;
@@ -226,132 +354,716 @@ public:
 		SDL_RenderCopy(renderer, texture, nullptr, &rect);
 	}
 
-	void SetText(std::string text)
+	// Does nothing when the text is already showing
+	void SetText(char const *text)
+	{
+		if (shown == text)
+		{
+			return;
+		}
+		shown = text;
+		Render();
+	}
+
+	// Draw the same text again in another font
+	void SetFont(TTF_Font *newFont)
+	{
+		font = newFont;
+		Render();
+	}
+
+	void Render()
 	{
 		SDL_FreeSurface(surface);
 		SDL_DestroyTexture(texture);
 
-		surface = TTF_RenderText_Solid(font, text.c_str(), {0xFF, 0xFF, 0xFF, 0xFF});
+		surface = TTF_RenderText_Solid(font, shown.c_str(), {0xFF, 0xFF, 0xFF, 0xFF});
 		texture = SDL_CreateTextureFromSurface(renderer, surface);
 
 		int width, height;
 		SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
 		rect.w = width;
 		rect.h = height;
+		changed = true;
 	}
 
 	SDL_Renderer *renderer;
 	TTF_Font *font;
+	std::string shown; // keeps its capacity, so steady text needs no allocations
 	SDL_Surface *surface{};
 	SDL_Texture *texture{};
 	SDL_Rect rect{};
+	bool changed = true; // since the HUD last drew it
 };
 
-
-// Helper Function
-Contact CheckPaddleCollision(Ball const &ball, Paddle const &paddle)
+// Scores, timer and labels composed into one window-sized texture, which
+// is drawn again only when a text on it changes or shows or hides. Every
+// other frame the whole HUD is a single copy. Renderers without render
+// targets draw the texts one by one as before.
+class HudLayer
 {
-	float ballLeft = ball.position.x;
-	float ballRight = ball.position.x + BALL_WIDTH;
-	float ballTop = ball.position.y;
-	float ballBottom = ball.position.y + BALL_HEIGHT;
+public:
+	explicit HudLayer(SDL_Renderer *renderer) : renderer(renderer)
+	{
+		target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, WIDTH, HEIGHT);
+		if (target)
+		{
+			SDL_SetTextureBlendMode(target, SDL_BLENDMODE_BLEND);
+		}
+	}
+
+	~HudLayer()
+	{
+		SDL_DestroyTexture(target);
+	}
+
+	HudLayer(HudLayer const &) = delete;
+	HudLayer &operator=(HudLayer const &) = delete;
+
+	void Add(TextClass *text, bool visible = true)
+	{
+		items.push_back(Item{text, visible});
+	}
+
+	void SetVisible(TextClass *text, bool visible)
+	{
+		for (Item &item : items)
+		{
+			if (item.text == text && item.visible != visible)
+			{
+				item.visible = visible;
+				dirty = true;
+			}
+		}
+	}
 
-	float paddleLeft = paddle.position.x;
-	float paddleRight = paddle.position.x + PADDLE_WIDTH;
-	float paddleTop = paddle.position.y;
-	float paddleBottom = paddle.position.y + PADDLE_HEIGHT;
+	// The target's contents are gone (SDL_RENDER_TARGETS_RESET)
+	void Invalidate()
+	{
+		dirty = true;
+	}
 
-	Contact contact{};
+	// Lists the texts on screen, and repaints the ones whose text changed.
+	// Before Draw, which forgets what changed.
+	void Track(DirtyRegions &regions) const
+	{
+		for (Item const &item : items)
+		{
+			DirtyRect bounds{item.text->rect.x, item.text->rect.y, item.text->rect.w, item.text->rect.h};
+			if (item.visible)
+			{
+				regions.Drawn(bounds);
+			}
+			if (item.text->changed)
+			{
+				regions.Mark(bounds);
+			}
+		}
+	}
 
-	if (ballLeft >= paddleRight)
+	// area limits the copy to part of the window; the clip rectangle does
+	// the same for renderers without render targets
+	void Draw(SDL_Rect const *area = nullptr)
 	{
-		return contact;
+		Update();
+		if (!target)
+		{
+			for (Item const &item : items)
+			{
+				if (item.visible)
+				{
+					item.text->Draw();
+				}
+			}
+			return;
+		}
+		SDL_RenderCopy(renderer, target, area, area);
 	}
 
-	if (ballRight <= paddleLeft)
+	// Redraws the target if anything on it changed. Draw does this too;
+	// call it first when drawing with a clip rectangle set.
+	void Update()
 	{
-		return contact;
+		for (Item &item : items)
+		{
+			dirty = dirty || item.text->changed;
+			item.text->changed = false;
+		}
+
+		if (target && dirty)
+		{
+			SDL_SetRenderTarget(renderer, target);
+			SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0x00);
+			SDL_RenderClear(renderer);
+			for (Item const &item : items)
+			{
+				if (item.visible)
+				{
+					item.text->Draw();
+				}
+			}
+			SDL_SetRenderTarget(renderer, nullptr);
+			dirty = false;
+			++redraws;
+		}
 	}
 
-	if (ballTop >= paddleBottom)
+	long long Redraws() const { return redraws; }
+
+private:
+	struct Item
+	{
+		TextClass *text;
+		bool visible;
+	};
+
+	SDL_Renderer *renderer;
+	SDL_Texture *target = nullptr;
+	std::vector<Item> items;
+	bool dirty = true;
+	long long redraws = 0;
+};
+
+// Picks up assets edited while the game runs (--watch DIR). The watcher
+// thread reads the changed file from that directory and decodes it, fonts
+// included; the render thread only swaps the result into the handles that
+// use it, in Apply once a frame.
+class HotReload
+{
+public:
+	HotReload()
 	{
-		return contact;
 	}
 
-	if (ballBottom <= paddleTop)
+	~HotReload()
 	{
-		return contact;
+		watcher.Stop();
+		for (Reloaded &item : ready)
+		{
+			Free(item);
+		}
 	}
 
-	float paddleRangeUpper = paddleBottom - (2.0f * PADDLE_HEIGHT / 3.0f);
-	float paddleRangeMiddle = paddleBottom - (PADDLE_HEIGHT / 3.0f);
+	HotReload(HotReload const &) = delete;
+	HotReload &operator=(HotReload const &) = delete;
 
-	if (ball.velocity.x < 0)
+	// Handles to keep up to date; all of them before Start
+	void TrackTexture(std::string const &name, SDL_Texture **slot)
 	{
-		// Left paddle
-		contact.penetration = paddleRight - ballLeft;
+		textures.push_back(Texture{name, slot});
 	}
-	else if (ball.velocity.x > 0)
+
+	// A font replaced here is closed here; the owner closes the last one,
+	// before HotReload goes away
+	void TrackFont(std::string const &name, TTF_Font **slot, int size, std::vector<TextClass *> const &texts)
 	{
-		// Right paddle
-		contact.penetration = paddleLeft - ballRight;
+		fonts.push_back(Font{name, slot, size, texts, {}});
 	}
 
-	if ((ballBottom > paddleTop) && (ballBottom < paddleRangeUpper))
+	bool Start(std::string const &directory)
 	{
-		contact.type = CollisionType::Top;
+		this->directory = directory.empty() || directory.back() == '/' ? directory : directory + "/";
+		return watcher.Start(directory, [this](std::string const &name, std::chrono::steady_clock::time_point seen)
+		{
+			Load(name, seen);
+		});
 	}
-	else if ((ballBottom > paddleRangeUpper) && (ballBottom < paddleRangeMiddle))
+
+	void Stop()
 	{
-		contact.type = CollisionType::Middle;
+		watcher.Stop();
 	}
-	else
+
+	// Render thread: swap in whatever finished loading
+	// True when something on screen was replaced
+	bool Apply(SDL_Renderer *renderer)
 	{
-		contact.type = CollisionType::Bottom;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			applying.swap(ready);
+		}
+		bool replaced = !applying.empty();
+
+		for (Reloaded &item : applying)
+		{
+			for (Texture &texture : textures)
+			{
+				SDL_Texture *fresh = texture.name == item.name && item.surface ? SDL_CreateTextureFromSurface(renderer, item.surface) : nullptr;
+				if (fresh)
+				{
+					SDL_DestroyTexture(*texture.slot);
+					*texture.slot = fresh;
+				}
+			}
+			SDL_FreeSurface(item.surface);
+			item.surface = nullptr;
+
+			for (OpenedFont &opened : item.fonts)
+			{
+				Font &font = fonts[opened.font];
+				for (TextClass *text : font.texts)
+				{
+					text->SetFont(opened.handle);
+				}
+				{
+					std::lock_guard<std::mutex> lock(faces);
+					TTF_CloseFont(*font.slot);
+				}
+				*font.slot = opened.handle;
+				font.bytes.swap(opened.bytes); // the font reads from these as long as it is open
+			}
+
+			float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - item.seen).count();
+			std::cout << "Reloaded " << item.name << ", on screen " << ms << " ms after it was saved" << std::endl;
+		}
+		applying.clear();
+		return replaced;
 	}
 
-	return contact;
+private:
+	struct Texture
+	{
+		std::string name;
+		SDL_Texture **slot;
+	};
+
+	struct Font
+	{
+		std::string name;
+		TTF_Font **slot;
+		int size;
+		std::vector<TextClass *> texts;
+		std::vector<uint8_t> bytes;
+	};
+
+	// A tracked font opened again at its size, with the file it reads from
+	struct OpenedFont
+	{
+		size_t font;
+		TTF_Font *handle;
+		std::vector<uint8_t> bytes;
+	};
+
+	struct Reloaded
+	{
+		std::string name;
+		std::chrono::steady_clock::time_point seen;
+		SDL_Surface *surface;
+		std::vector<OpenedFont> fonts;
+	};
+
+	static void Free(Reloaded &item)
+	{
+		SDL_FreeSurface(item.surface);
+		for (OpenedFont &opened : item.fonts)
+		{
+			TTF_CloseFont(opened.handle);
+		}
+	}
+
+	// Watcher thread
+	void Load(std::string const &name, std::chrono::steady_clock::time_point seen)
+	{
+		bool texture = false;
+		bool font = false;
+		for (Texture const &tracked : textures)
+		{
+			texture = texture || tracked.name == name;
+		}
+		for (Font const &tracked : fonts)
+		{
+			font = font || tracked.name == name;
+		}
+		SDL_RWops *source = texture || font ? SDL_RWFromFile((directory + name).c_str(), "rb") : nullptr;
+		if (!source)
+		{
+			return;
+		}
+
+		Reloaded item{name, seen, nullptr, {}};
+		if (texture)
+		{
+			item.surface = IMG_Load_RW(source, 1);
+		}
+		else
+		{
+			std::vector<uint8_t> bytes;
+			Sint64 size = SDL_RWsize(source);
+			bytes.resize(size > 0 ? static_cast<size_t>(size) : 0);
+			if (SDL_RWread(source, bytes.data(), 1, bytes.size()) != bytes.size())
+			{
+				bytes.clear();
+			}
+			SDL_RWclose(source);
+
+			// Each size is a font of its own, reading its own copy of the file
+			for (size_t i = 0; i < fonts.size() && !bytes.empty(); ++i)
+			{
+				if (fonts[i].name != name)
+				{
+					continue;
+				}
+				OpenedFont opened{i, nullptr, bytes};
+				{
+					std::lock_guard<std::mutex> lock(faces);
+					opened.handle = TTF_OpenFontRW(SDL_RWFromConstMem(opened.bytes.data(), static_cast<int>(opened.bytes.size())), 1, fonts[i].size);
+				}
+				if (!opened.handle)
+				{
+					Free(item);
+					item.fonts.clear();
+					break;
+				}
+				item.fonts.push_back(std::move(opened));
+			}
+		}
+		if (!item.surface && item.fonts.empty())
+		{
+			std::cout << "Cannot reload " << name << std::endl;
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		ready.push_back(std::move(item));
+	}
+
+	std::string directory;
+	DirectoryWatcher watcher;
+	std::vector<Texture> textures;
+	std::vector<Font> fonts;
+	std::mutex faces; // FreeType opens and closes faces one at a time
+	std::mutex mutex;
+	std::vector<Reloaded> ready;    // loaded, waiting for the render thread
+	std::vector<Reloaded> applying; // render thread only
+};
+
+
+
+// Team's paddle picked by a number key, or -1. Blue uses the number row
+// (1 to 9, 0, -), Red the keypad (1 to 9, 0, .).
+int PaddleHotkey(SDL_Keycode key, Team team)
+{
+	if (team == Team::One)
+	{
+		if (key >= SDLK_1 && key <= SDLK_9)
+		{
+			return key - SDLK_1;
+		}
+		return key == SDLK_0 ? 9 : key == SDLK_MINUS ? 10 : -1;
+	}
+
+	if (key >= SDLK_KP_1 && key <= SDLK_KP_9)
+	{
+		return key - SDLK_KP_1;
+	}
+	return key == SDLK_KP_0 ? 9 : key == SDLK_KP_PERIOD ? 10 : -1;
 }
 
-Contact CheckWallCollision(Ball const &ball)
+// Ticks run per frame at most; beyond that the game slows down instead of
+// spending ever longer catching up
+const int MAX_CATCH_UP = 8;
+
+// Particle vertices go to SDL_RenderGeometry as they are
+static_assert(sizeof(ParticleVertex) == sizeof(SDL_Vertex), "ParticleVertex must match SDL_Vertex");
+static_assert(offsetof(ParticleVertex, r) == offsetof(SDL_Vertex, color), "ParticleVertex must match SDL_Vertex");
+static_assert(offsetof(ParticleVertex, u) == offsetof(SDL_Vertex, tex_coord), "ParticleVertex must match SDL_Vertex");
+
+// Replay scrub bar along the bottom of the window
+const int SCRUB_X = 40, SCRUB_Y = HEIGHT - 24, SCRUB_W = WIDTH - 80, SCRUB_H = 10;
+
+int ScrubTick(int mouseX, int ticks)
 {
-	float ballLeft = ball.position.x;
-	float ballRight = ball.position.x + BALL_WIDTH;
-	float ballTop = ball.position.y;
-	float ballBottom = ball.position.y + BALL_HEIGHT;
+	float fraction = static_cast<float>(mouseX - SCRUB_X) / SCRUB_W;
+	fraction = fraction < 0.0f ? 0.0f : fraction > 1.0f ? 1.0f : fraction;
+	return static_cast<int>(fraction * ticks);
+}
 
-	Contact contact{};
+// Space pauses, 1/2/3 pick 1x/10x/max speed, Left/Right jump ten seconds and
+// the scrub bar can be clicked or dragged. Returns false for other events.
+bool HandleReplayEvent(SDL_Event const &event, ReplayPlayer &player, int ticks, bool &scrubbing)
+{
+	const int jump = static_cast<int>(10000.0f / TICK_MS);
 
-	if (ballLeft < 0.0f)
+	if (event.type == SDL_KEYDOWN)
 	{
-		contact.type = CollisionType::Left;
+		switch (event.key.keysym.sym)
+		{
+		case SDLK_SPACE:
+			player.paused = !player.paused;
+			return true;
+		case SDLK_1:
+			player.speed = ReplayPlayer::Speed::Normal;
+			return true;
+		case SDLK_2:
+			player.speed = ReplayPlayer::Speed::Fast;
+			return true;
+		case SDLK_3:
+			player.speed = ReplayPlayer::Speed::Max;
+			return true;
+		case SDLK_LEFT:
+			player.SeekTo(player.CurrentTick() - jump);
+			return true;
+		case SDLK_RIGHT:
+			player.SeekTo(player.CurrentTick() + jump);
+			return true;
+		case SDLK_r:
+			player.SeekTo(0);
+			return true;
+		default:
+			return false;
+		}
 	}
-	else if (ballRight > WIDTH)
+	else if (event.type == SDL_MOUSEBUTTONDOWN && event.button.button == SDL_BUTTON_LEFT &&
+			 event.button.y >= SCRUB_Y - 10 && event.button.y <= SCRUB_Y + SCRUB_H + 10)
 	{
-		contact.type = CollisionType::Right;
+		scrubbing = true;
+		player.SeekTo(ScrubTick(event.button.x, ticks));
+		return true;
 	}
-	else if (ballTop < 0.0f)
+	else if (event.type == SDL_MOUSEMOTION && scrubbing)
 	{
-		contact.type = CollisionType::Top;
-		contact.penetration = -ballTop;
+		player.SeekTo(ScrubTick(event.motion.x, ticks));
+		return true;
 	}
-	else if (ballBottom > HEIGHT)
+	else if (event.type == SDL_MOUSEBUTTONUP && event.button.button == SDL_BUTTON_LEFT)
 	{
-		contact.type = CollisionType::Bottom;
-		contact.penetration = HEIGHT - ballBottom;
+		scrubbing = false;
+		return true;
 	}
 
-	return contact;
+	return false;
 }
 
+void DrawScrubBar(SDL_Renderer *renderer, float progress)
+{
+	SDL_Rect bar{SCRUB_X, SCRUB_Y, SCRUB_W, SCRUB_H};
+	SDL_SetRenderDrawColor(renderer, 0x40, 0x40, 0x40, 0xFF);
+	SDL_RenderFillRect(renderer, &bar);
 
+	bar.w = static_cast<int>(progress * SCRUB_W);
+	SDL_SetRenderDrawColor(renderer, 0xE0, 0xE0, 0xE0, 0xFF);
+	SDL_RenderFillRect(renderer, &bar);
+
+	SDL_Rect knob{SCRUB_X + bar.w - 4, SCRUB_Y - 5, 8, SCRUB_H + 10};
+	SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+	SDL_RenderFillRect(renderer, &knob);
+}
 
 // Main
 int main(int argc, char *argv[])
 {
+	// Online play: --host PORT or --join HOST:PORT. --latency MS, --jitter MS
+	// and --loss RATE make the connection worse on purpose for testing.
+	// --record FILE saves a local match, --replay FILE plays one back.
+	// --feed NAME renames the shared memory spectator feed (see spectate.cpp).
+	// --bot blue|red hands that team to an external bot process (see bot.cpp),
+	// which gets --bot-deadline MS per tick to answer.
+	// --team-size N plays local matches with N paddles a side.
+	// --pack FILE loads the assets from that pack (see pack.cpp); --pack none
+	// decodes the loose files in assets/ instead. --mods DIR overrides any
+	// asset with a file of the same name in DIR. --watch DIR does the same and
+	// reloads files in DIR as they are saved.
+	// --dirty on|off|auto repaints only the parts of the window that changed
+	// (see dirty.h); auto does so when SDL falls back to software rendering.
+	// --capture DIR|FILE.y4m records what is shown at 60 fps (see capture.h).
+	auto processStart = std::chrono::steady_clock::now();
+	int hostPort = 0;
+	std::string joinAddress;
+	std::string recordPath;
+	std::string replayPath;
+	std::string feedName = SPECTATOR_FEED;
+	std::string botTeam;
+	float botDeadline = BOT_DEADLINE_MS;
+	Rules localRules;
+	std::string packPath;
+	std::string modsDir;
+	std::string watchDir;
+	std::string dirtyRendering = "auto";
+	std::string capturePath;
+	LinkConditions conditions;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		if (flag == "--host")
+		{
+			hostPort = std::atoi(argv[i + 1]);
+		}
+		else if (flag == "--join")
+		{
+			joinAddress = argv[i + 1];
+		}
+		else if (flag == "--latency")
+		{
+			conditions.latencyMs = static_cast<float>(std::atof(argv[i + 1]));
+		}
+		else if (flag == "--jitter")
+		{
+			conditions.jitterMs = static_cast<float>(std::atof(argv[i + 1]));
+		}
+		else if (flag == "--loss")
+		{
+			conditions.lossRate = static_cast<float>(std::atof(argv[i + 1]));
+		}
+		else if (flag == "--record")
+		{
+			recordPath = argv[i + 1];
+		}
+		else if (flag == "--replay")
+		{
+			replayPath = argv[i + 1];
+		}
+		else if (flag == "--feed")
+		{
+			feedName = argv[i + 1];
+		}
+		else if (flag == "--bot")
+		{
+			botTeam = argv[i + 1];
+		}
+		else if (flag == "--bot-deadline")
+		{
+			botDeadline = static_cast<float>(std::atof(argv[i + 1]));
+		}
+		else if (flag == "--team-size")
+		{
+			localRules.teamSize = std::atoi(argv[i + 1]);
+		}
+		else if (flag == "--pack")
+		{
+			packPath = argv[i + 1];
+		}
+		else if (flag == "--mods")
+		{
+			modsDir = argv[i + 1];
+		}
+		else if (flag == "--watch")
+		{
+			watchDir = argv[i + 1];
+		}
+		else if (flag == "--dirty")
+		{
+			dirtyRendering = argv[i + 1];
+		}
+		else if (flag == "--capture")
+		{
+			capturePath = argv[i + 1];
+		}
+	}
+	if (modsDir.empty())
+	{
+		modsDir = watchDir;
+	}
+
+	ReplayReader replay;
+	std::unique_ptr<ReplayPlayer> player;
+	if (!replayPath.empty())
+	{
+		std::string error = replay.Open(replayPath);
+		if (!error.empty())
+		{
+			std::cout << "Error: " << error << std::endl;
+			return 1;
+		}
+		player.reset(new ReplayPlayer(replay));
+	}
+
+	UdpSocket socket;
+	NetLink link(socket, conditions);
+	std::unique_ptr<RollbackSession> session;
+	if (hostPort > 0)
+	{
+		if (!socket.Bind(static_cast<uint16_t>(hostPort)))
+		{
+			std::cout << "Error: cannot listen on port " << hostPort << std::endl;
+			return 1;
+		}
+		session.reset(new RollbackSession(Team::One, link, Endpoint()));
+	}
+	else if (!joinAddress.empty())
+	{
+		size_t colon = joinAddress.rfind(':');
+		Endpoint peer;
+		if (colon != std::string::npos)
+		{
+			peer = Endpoint::Resolve(joinAddress.substr(0, colon), static_cast<uint16_t>(std::atoi(joinAddress.c_str() + colon + 1)));
+		}
+		if (!peer.valid || !socket.Bind(0))
+		{
+			std::cout << "Error: cannot reach " << joinAddress << std::endl;
+			return 1;
+		}
+		session.reset(new RollbackSession(Team::Two, link, peer));
+	}
+
+	// Online matches are always the default rules; a replay brings its own
+	Rules rules = player ? replay.GetRules() : session ? Rules() : localRules;
+
+	// Spectating is optional; the game runs the same without it
+	SpectatorFeed feed;
+	SnapshotCodec feedCodec(Precision::Quantized, rules);
+	uint32_t feedTick = 0;
+	if (!feed.Open(feedName, TeamSizeOf(rules)))
+	{
+		std::cout << "No spectator feed: cannot create " << feedName << std::endl;
+	}
+
+	// An external bot plays one team in local matches
+	BotLink botLink;
+	Team botSide = botTeam == "red" ? Team::Two : Team::One;
+	if (!botTeam.empty() && !session && !player)
+	{
+		if (botTeam != "blue" && botTeam != "red")
+		{
+			std::cout << "Error: --bot takes blue or red" << std::endl;
+			return 1;
+		}
+		if (!botLink.Open(botSide, rules))
+		{
+			std::cout << "Error: cannot create " << BotChannelName(botSide) << std::endl;
+			return 1;
+		}
+		std::cout << "Waiting for a bot on " << BotChannelName(botSide) << std::endl;
+	}
+
+	ReplayWriter recorder;
+	if (!recordPath.empty() && !session && !player && !recorder.Open(recordPath, rules))
+	{
+		std::cout << "Error: cannot write " << recordPath << std::endl;
+		return 1;
+	}
+
 	// Init
+	auto sdlStart = std::chrono::steady_clock::now();
 	SDL_Init(SDL_INIT_EVERYTHING|SDL_INIT_TIMER);
 	TTF_Init(); // Score
+
+	// Assets come out of the pack when there is one; anything it lacks is
+	// decoded from its own file in the background while the window opens
+	auto assetsStart = std::chrono::steady_clock::now();
+	AssetFiles files(modsDir);
+	AssetPack pack;
+	std::string packError;
+	if (!packPath.empty() && packPath != "none")
+	{
+		packError = pack.Open(packPath);
+	}
+	else if (packPath.empty() && files.Path(PACK_NAME).empty())
+	{
+		EmbeddedFile const *built = files.Embedded(PACK_NAME);
+		packError = pack.Open(built->data, built->size);
+	}
+	else if (packPath.empty() && AssetFiles::Exists(files.Path(PACK_NAME)))
+	{
+		packError = pack.Open(files.Path(PACK_NAME));
+	}
+	if (!packError.empty())
+	{
+		std::cout << "Asset pack: " << packError << ", loading loose files" << std::endl;
+	}
+	AssetLoader assets(pack, files);
+	assets.Start({"ball.png", "blue/image_part_004.png", "red/image.png", "football-pitch.png"});
+
+	auto windowStart = std::chrono::steady_clock::now();
 	SDL_Window *window = SDL_CreateWindow("Tiny Ball", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
 										  WIDTH, HEIGHT, SDL_WINDOW_ALLOW_HIGHDPI);
 	if (!window)
@@ -360,57 +1072,195 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 	SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0);
-	TTF_Font *scoreFont = TTF_OpenFont("./assets/DejaVuSansMono.ttf", 40);
+
+	// The software renderer would blend the whole window every frame. In
+	// dirty rectangle mode it draws into the window surface instead, only
+	// where something changed, and only those rectangles are presented.
+	SDL_RendererInfo rendererInfo{};
+	bool software = !renderer || (SDL_GetRendererInfo(renderer, &rendererInfo) == 0 && (rendererInfo.flags & SDL_RENDERER_SOFTWARE));
+	bool dirtyMode = dirtyRendering == "on" || (dirtyRendering == "auto" && software);
+	if (dirtyMode)
+	{
+		SDL_DestroyRenderer(renderer);
+		SDL_Surface *windowSurface = SDL_GetWindowSurface(window);
+		renderer = windowSurface && windowSurface->w == WIDTH && windowSurface->h == HEIGHT ? SDL_CreateSoftwareRenderer(windowSurface) : nullptr;
+		if (renderer)
+		{
+			std::cout << "Software rendering, repainting only dirty rectangles" << std::endl;
+		}
+		else
+		{
+			std::cout << "No dirty rectangles: " << SDL_GetError() << std::endl;
+			dirtyMode = false;
+			renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+		}
+	}
+	DirtyRegions dirty;
+	std::vector<SDL_Rect> dirtyRects;
+
+	// Frames go to background encoders; when they fall behind, frames are
+	// dropped from the recording rather than held up on screen
+	FrameCapture capture;
+	float captureDueMs = 0.0f;
+	if (!capturePath.empty())
+	{
+		int outputWidth = WIDTH, outputHeight = HEIGHT;
+		SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+		std::string error = capture.Open(capturePath, outputWidth, outputHeight);
+		if (!error.empty())
+		{
+			std::cout << "Error: " << error << std::endl;
+			return 1;
+		}
+	}
+
+	// Copies the finished frame, before it is presented, once per 1/60 s
+	auto captureFrame = [&]()
+	{
+		if (!capture.IsOpen() || captureDueMs > 0.0f)
+		{
+			return;
+		}
+		// A frame that ran long does not owe the recording extra frames
+		captureDueMs = captureDueMs + 1000.0f / CAPTURE_FPS < 0.0f ? 0.0f : captureDueMs + 1000.0f / CAPTURE_FPS;
+		uint8_t *pixels = capture.Acquire();
+		if (!pixels)
+		{
+			return;
+		}
+		if (dirtyMode)
+		{
+			// The window surface holds the whole frame, dirty or not
+			SDL_Surface *shown = SDL_GetWindowSurface(window);
+			SDL_ConvertPixels(capture.Width(), capture.Height(), shown->format->format, shown->pixels, shown->pitch,
+							  SDL_PIXELFORMAT_RGBA32, pixels, capture.Width() * 4);
+		}
+		else
+		{
+			SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA32, pixels, capture.Width() * 4);
+		}
+		capture.Submit();
+	};
+
+	// Sound. Small buffers keep the latency down; SDL_AUDIODRIVER=disk or
+	// dummy runs the mixer without a sound card.
+	Mixer mixer;
+	LoadSound(mixer, files, Sound::Kick, "kick.wav");
+	LoadSound(mixer, files, Sound::Bounce, "bounce.wav");
+	LoadSound(mixer, files, Sound::Goal, "goal.wav");
+	LoadSound(mixer, files, Sound::Whistle, "whistle.wav");
+	SDL_AudioSpec wantAudio{};
+	wantAudio.freq = AUDIO_RATE;
+	wantAudio.format = AUDIO_F32SYS;
+	wantAudio.channels = 2;
+	wantAudio.samples = AUDIO_FRAMES;
+	wantAudio.callback = [](void *user, Uint8 *stream, int bytes)
+	{
+		static_cast<Mixer *>(user)->Mix(reinterpret_cast<float *>(stream), bytes / static_cast<int>(2 * sizeof(float)));
+	};
+	wantAudio.userdata = &mixer;
+	SDL_AudioSpec haveAudio{};
+	SDL_AudioDeviceID audio = SDL_OpenAudioDevice(nullptr, 0, &wantAudio, &haveAudio, 0);
+	if (audio)
+	{
+		std::cout << "Audio: " << SDL_GetCurrentAudioDriver() << ", " << haveAudio.samples << " frame buffer ("
+				  << 1000.0f * haveAudio.samples / haveAudio.freq << " ms)" << std::endl;
+		SDL_PauseAudioDevice(audio, 0);
+	}
+	else
+	{
+		std::cout << "No audio: " << SDL_GetError() << std::endl;
+	}
+	auto uploadStart = std::chrono::steady_clock::now();
+	float decodeWaitMs = assets.Wait();
+	TTF_Font *scoreFont = LoadFont(pack, files, "DejaVuSansMono.ttf", 40);
 
 	// Init
+	Match match(rules);
 
-	Ball ball(
-		Vec2((WIDTH / 2.0f) - (BALL_WIDTH / 2.0f),
-			 (HEIGHT / 2.0f) - (BALL_WIDTH / 2.0f)),
-		Vec2(BALL_SPEED, 0.0f), renderer);
+	Sprite ballSprite(renderer, assets, "ball.png", BALL_WIDTH, BALL_HEIGHT);
 
 	TextClass playerOneScoreText(Vec2(WIDTH / 4, 50), renderer, scoreFont);
 	TextClass playerTwoScoreText(Vec2(3 * WIDTH / 4, 50), renderer, scoreFont);
+	TextClass waiting(Vec2(WIDTH / 4, HEIGHT / 2 - 100), renderer, scoreFont, "Waiting for player...");
 
 	// Create the paddles
-	Paddle paddleOneA(
-		Vec2(80.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f)),
-		Vec2(0.0f, 0.0f),
-		renderer,"./assets/blue/image_part_004.png");
-	Paddle paddleOneB(
-		Vec2(160.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f)),
-		Vec2(0.0f, 0.0f),
-		renderer,"./assets/blue/image_part_004.png");
-
-	Paddle paddleTwoA(
-		Vec2(WIDTH - 80.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f)),
-		Vec2(0.0f, 0.0f),
-		renderer,"./assets/red/image.png");
-	Paddle paddleTwoB(
-		Vec2(WIDTH - 160.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f)),
-		Vec2(0.0f, 0.0f),
-		renderer,"./assets/red/image.png");
-
-	Paddle *currentOne = &paddleOneA;
-	Paddle *currentTwo = &paddleTwoA;
-	SDL_Surface *image = IMG_Load("./assets/football-pitch.png");
-	SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, image);
-
-	int playerOneScore = 0;
-	int playerTwoScore = 0;
+	Sprite blueSprite(renderer, assets, "blue/image_part_004.png", PADDLE_WIDTH, PADDLE_HEIGHT);
+	Sprite redSprite(renderer, assets, "red/image.png", PADDLE_WIDTH, PADDLE_HEIGHT);
+
+	SDL_Texture *texture = assets.Texture(renderer, "football-pitch.png");
+	auto uploadEnd = std::chrono::steady_clock::now();
+	bool firstFrame = true;
+
 	bool running = true;
 	bool buttons[4] = {};
 
+	// Switch and restart presses waiting for the next tick
+	uint8_t pressedOne = 0;
+	uint8_t pressedTwo = 0;
+
+	// Keep the paddle nearest the ball selected, toggled with the Ctrl keys
+	bool nearestOne = false;
+	bool nearestTwo = false;
+
+	// Computer control for Red, toggled with C
+	bool aiTwo = false;
+	AiParams aiParams;
+
 	float dt = 0.0f;
+	float accumulator = 0.0f;
 
-	bool resetGame = false;
-	float totalTime = 0.0f;
+	// Text and other temporaries that only live until the frame is shown
+	FrameArena frameArena(4 * 1024);
 
-	TextClass timer(Vec2(WIDTH / 4 + 55, HEIGHT * 8 / 10), renderer, scoreFont, "Time: " + std::to_string(totalTime) + "s / 90s");
+	// Sparks for paddle hits and goals, drawn in one batch
+	ParticlePool particles;
+	const float PARTICLE_BUDGET_MS = 4.0f;
+
+	int shownOneScore = 0;
+	int shownTwoScore = 0;
+
+	bool scrubbing = false;
+
+	// Match clock when the last whistle was considered
+	float whistledTime = 0.0f;
+	bool whistledEnd = false;
+
+	TextClass timer(Vec2(WIDTH / 4 + 55, HEIGHT * 8 / 10), renderer, scoreFont, ("Time: " + std::to_string(match.totalTime) + "s / 90s").c_str());
+
+	HudLayer hud(renderer);
+	hud.Add(&playerOneScoreText);
+	hud.Add(&playerTwoScoreText);
+	hud.Add(&timer);
+	hud.Add(&waiting, false);
+	long long hudFrames = 0;
+
+	// Assets saved in the watched directory replace the ones on screen
+	HotReload hotReload;
+	if (!watchDir.empty())
+	{
+		hotReload.TrackTexture("ball.png", &ballSprite.texture);
+		hotReload.TrackTexture("blue/image_part_004.png", &blueSprite.texture);
+		hotReload.TrackTexture("red/image.png", &redSprite.texture);
+		hotReload.TrackTexture("football-pitch.png", &texture);
+		hotReload.TrackFont("DejaVuSansMono.ttf", &scoreFont, 40, {&playerOneScoreText, &playerTwoScoreText, &waiting, &timer});
+		if (hotReload.Start(watchDir))
+		{
+			std::cout << "Watching " << watchDir << " for asset changes" << std::endl;
+		}
+		else
+		{
+			std::cout << "Error: cannot watch " << watchDir << std::endl;
+		}
+	}
 	
 	while (running)
 	{
 		auto startTime = std::chrono::high_resolution_clock::now();
+		if (hotReload.Apply(renderer))
+		{
+			dirty.MarkAll();
+		}
 		// Check for reset button press
 
 		SDL_Event event;
@@ -420,6 +1270,19 @@ int main(int argc, char *argv[])
 			{
 				running = false;
 			}
+			else if (event.type == SDL_RENDER_TARGETS_RESET)
+			{
+				hud.Invalidate();
+				dirty.MarkAll();
+			}
+			else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED)
+			{
+				dirty.MarkAll();
+			}
+			else if (player && HandleReplayEvent(event, *player, replay.TickCount(), scrubbing))
+			{
+				continue;
+			}
 			else if (event.type == SDL_KEYDOWN)
 			{
 				if (event.key.keysym.sym == SDLK_ESCAPE)
@@ -445,46 +1308,38 @@ int main(int argc, char *argv[])
 				else if (event.key.keysym.sym == SDLK_LSHIFT)
 				{
 					std::cout << event.key.keysym.sym;
-					if (currentOne == &paddleOneA)
-					{
-						currentOne = &paddleOneB;
-					}
-					else
-					{
-						currentOne = &paddleOneA;
-					}
+					pressedOne |= InputSwitch;
 				}
 				else if (event.key.keysym.sym == SDLK_RSHIFT)
 				{
 					std::cout << event.key.keysym.sym;
-					if (currentTwo == &paddleTwoA)
-					{
-						currentTwo = &paddleTwoB;
-					}
-					else
-					{
-						currentTwo = &paddleTwoA;
-					}
+					pressedTwo |= InputSwitch;
+				}
+				else if (event.key.keysym.sym == SDLK_LCTRL)
+				{
+					nearestOne = !nearestOne;
+				}
+				else if (event.key.keysym.sym == SDLK_RCTRL)
+				{
+					nearestTwo = !nearestTwo;
+				}
+				else if (PaddleHotkey(event.key.keysym.sym, Team::One) >= 0)
+				{
+					pressedOne = (pressedOne & ~0xF0) | InputSelect(PaddleHotkey(event.key.keysym.sym, Team::One));
+				}
+				else if (PaddleHotkey(event.key.keysym.sym, Team::Two) >= 0)
+				{
+					pressedTwo = (pressedTwo & ~0xF0) | InputSelect(PaddleHotkey(event.key.keysym.sym, Team::Two));
+				}
+				else if (event.key.keysym.sym == SDLK_c && !session)
+				{
+					aiTwo = !aiTwo;
+					buttons[Buttons::PaddleTwoUp] = false;
+					buttons[Buttons::PaddleTwoDown] = false;
 				}
 				else if (event.key.keysym.sym == SDLK_r)
 				{
-					resetGame = false;
-					totalTime = 0.0f;
-					paddleOneA.position = Vec2(80.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f));
-					paddleOneB.position = Vec2(160.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f));
-					paddleTwoA.position = Vec2(WIDTH - 80.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f));
-					paddleTwoB.position = Vec2(WIDTH - 160.0f, (HEIGHT / 2.0f) - (PADDLE_HEIGHT / 2.0f));
-					Paddle *currentOne = &paddleOneA;
-					Paddle *currentTwo = &paddleTwoA;
-					playerOneScore = 0;
-					playerTwoScore = 0;
-					playerOneScoreText.SetText("0");
-					playerTwoScoreText.SetText("0");
-					playerOneScoreText.Draw();
-					playerTwoScoreText.Draw();
-					ball.position = Vec2((WIDTH / 2.0f) - (BALL_WIDTH / 2.0f),(HEIGHT / 2.0f) - (BALL_WIDTH / 2.0f));
-					SDL_RenderCopy(renderer, texture, NULL, NULL);
-					SDL_RenderPresent(renderer);
+					pressedOne |= InputRestart;
 				}
 			}
 			else if (event.type == SDL_KEYUP)
@@ -508,141 +1363,297 @@ int main(int argc, char *argv[])
 			}
 		}
 
-		if (buttons[Buttons::PaddleOneUp])
+		// Run as many fixed ticks as the elapsed time calls for
+		accumulator += dt;
+		int ticks = 0;
+		if (player)
 		{
-			currentOne->velocity.y = -PADDLE_SPEED;
+			player->Advance(scrubbing ? 0.0f : dt, [&](MatchEvent event, Transform const &ball)
+			{
+				particles.Emit(EventBurst(event, ball, player->State().balls.Get<Velocity>(0)));
+				PlayEvent(mixer, event, ball);
+			});
+			feed.Publish(feedCodec.Capture(player->State(), static_cast<uint32_t>(player->CurrentTick())));
+			accumulator = 0.0f;
 		}
-		else if (buttons[Buttons::PaddleOneDown])
+		while (accumulator >= TICK_MS && ticks < MAX_CATCH_UP)
 		{
-			currentOne->velocity.y = PADDLE_SPEED;
+			uint8_t inputOne = pressedOne |
+							   (buttons[Buttons::PaddleOneUp] ? InputUp : 0) |
+							   (buttons[Buttons::PaddleOneDown] ? InputDown : 0);
+			uint8_t inputTwo = pressedTwo |
+							   (buttons[Buttons::PaddleTwoUp] ? InputUp : 0) |
+							   (buttons[Buttons::PaddleTwoDown] ? InputDown : 0);
+			if (nearestOne && !(inputOne >> INPUT_SELECT_SHIFT))
+			{
+				inputOne |= INPUT_SELECT_NEAREST << INPUT_SELECT_SHIFT;
+			}
+			if (nearestTwo && !(inputTwo >> INPUT_SELECT_SHIFT))
+			{
+				inputTwo |= INPUT_SELECT_NEAREST << INPUT_SELECT_SHIFT;
+			}
+
+			if (session)
+			{
+				// Online either set of keys plays our own team; a paddle picked
+				// with Blue's keys wins over one picked with Red's
+				uint8_t select = (inputOne >> INPUT_SELECT_SHIFT) ? inputOne & 0xF0 : inputTwo & 0xF0;
+				if (!session->AdvanceTick(((inputOne | inputTwo) & 0x0F) | select))
+				{
+					break;
+				}
+			}
+			else
+			{
+				if (aiTwo)
+				{
+					inputTwo = AiInput(DecideAi(match, Team::Two, aiParams));
+				}
+				if (botLink.IsOpen())
+				{
+					uint8_t &input = botSide == Team::One ? inputOne : inputTwo;
+					input = (input & InputRestart) | botLink.Decide(match, feedTick, botDeadline);
+				}
+				recorder.Record(match, inputOne, inputTwo);
+				Transform ball = match.balls.Get<Transform>(0);
+				MatchEvent event = match.Tick(inputOne, inputTwo);
+				particles.Emit(EventBurst(event, ball, match.balls.Get<Velocity>(0)));
+				PlayEvent(mixer, event, ball);
+			}
+
+			feed.Publish(feedCodec.Capture(session ? session->State() : match, ++feedTick));
+
+			pressedOne = 0;
+			pressedTwo = 0;
+			accumulator -= TICK_MS;
+			++ticks;
 		}
-		else
+		if (accumulator > MAX_CATCH_UP * TICK_MS)
 		{
-			currentOne->velocity.y = 0.0f;
+			accumulator = MAX_CATCH_UP * TICK_MS;
 		}
 
-		if (buttons[Buttons::PaddleTwoUp])
+		Match const &state = player ? player->State() : session ? session->State() : match;
+
+		// Whistle for kickoff (the clock starting, or a restart putting it
+		// back) and for full time. Seeking a replay back stays quiet.
+		if (state.totalTime > 0.0f && (whistledTime == 0.0f || (state.totalTime < whistledTime && !player)))
 		{
-			currentTwo->velocity.y = -PADDLE_SPEED;
+			mixer.Play(Sound::Whistle);
 		}
-		else if (buttons[Buttons::PaddleTwoDown])
+		if (state.finished && !whistledEnd)
 		{
-			currentTwo->velocity.y = PADDLE_SPEED;
+			mixer.Play(Sound::Whistle);
 		}
-		else
+		whistledEnd = state.finished;
+		whistledTime = state.totalTime;
+
+		// Scores can also go down online when a rollback takes a goal back
+		if (state.playerOneScore != shownOneScore)
 		{
-			currentTwo->velocity.y = 0.0f;
+			shownOneScore = state.playerOneScore;
+			playerOneScoreText.SetText(frameArena.Format("%d", shownOneScore));
+		}
+		if (state.playerTwoScore != shownTwoScore)
+		{
+			shownTwoScore = state.playerTwoScore;
+			playerTwoScoreText.SetText(frameArena.Format("%d", shownTwoScore));
 		}
 
-		if (resetGame)
+		if (state.finished && !player)
 		{
-			// Reset game variables here
-			// For example, reset paddle positions, ball position, scores, etc.
 			// Clear the window to black
 			SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xFF);
 			SDL_RenderClear(renderer);
 			TextClass resultteam (Vec2(WIDTH / 3 + 50 , HEIGHT/ 2 - 100), renderer, scoreFont);
 			resultteam.SetText("Blue - Red");
 			resultteam.Draw();
-			std::string restext = std::to_string(playerOneScore) + " - " + std::to_string(playerTwoScore);
 			TextClass result1 (Vec2(WIDTH / 2 - 70, HEIGHT/ 2), renderer, scoreFont);
-			result1.SetText(restext);
+			result1.SetText(frameArena.Format("%d - %d", state.playerOneScore, state.playerTwoScore));
 			result1.Draw();
 			TextClass reminder (Vec2(WIDTH / 4, HEIGHT * 9/ 10), renderer, scoreFont);
 			reminder.SetText("Press R to play again");
 			reminder.Draw();
-			SDL_RenderPresent(renderer);
+			captureFrame();
+			if (dirtyMode)
+			{
+				SDL_UpdateWindowSurface(window);
+				dirty.MarkAll();
+			}
+			else
+			{
+				SDL_RenderPresent(renderer);
+			}
 		}
 		else {
-				// Update the paddle positions
-				paddleOneA.Update(dt);
-				paddleOneB.Update(dt);
-				paddleTwoA.Update(dt);
-				paddleTwoB.Update(dt);
-
-				// Update the ball position
-				ball.Update(dt);
-
-				// Check collisions
-				if (Contact contact = CheckPaddleCollision(ball, paddleOneA);
-					contact.type != CollisionType::None)
-				{
-					ball.CollideWithPaddle(contact);
-				}
-				else if (Contact contact = CheckPaddleCollision(ball, paddleOneB);
-						contact.type != CollisionType::None)
-				{
-					ball.CollideWithPaddle(contact);
-				}
-				else if (contact = CheckPaddleCollision(ball, paddleTwoA);
-						contact.type != CollisionType::None)
-				{
-					ball.CollideWithPaddle(contact);
-				}
-				else if (contact = CheckPaddleCollision(ball, paddleTwoB);
-						contact.type != CollisionType::None)
-				{
-					ball.CollideWithPaddle(contact);
-				}
-				else if (contact = CheckWallCollision(ball);
-						contact.type != CollisionType::None)
-				{
-					ball.CollideWithWall(contact);
-					if (contact.type == CollisionType::Left)
-					{
-						++playerTwoScore;
-						playerTwoScoreText.SetText(std::to_string(playerTwoScore));
-					}
-					else if (contact.type == CollisionType::Right)
-					{
-						++playerOneScore;
-						playerOneScoreText.SetText(std::to_string(playerOneScore));
-					}
-				}
-
 				//
 				// Rendering will happen here
 				//
-				SDL_RenderCopy(renderer, texture, NULL, NULL);
-				// SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+				Sprite *sprites[] = {&ballSprite, &blueSprite, &redSprite}; // by SpriteId
+
+				// Particles are drawn in one call, thinned out when they take
+				// longer than their share of the frame
+				auto particleStart = std::chrono::high_resolution_clock::now();
+				particles.Update(dt);
+				int quads = particles.BuildVertices();
+				float const *sparks = particles.Bounds();
+				SDL_Rect sparkBounds{static_cast<int>(std::floor(sparks[0])), static_cast<int>(std::floor(sparks[1])),
+									 static_cast<int>(std::ceil(sparks[2]) - std::floor(sparks[0])),
+									 static_cast<int>(std::ceil(sparks[3]) - std::floor(sparks[1]))};
+				float particleMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - particleStart).count();
+
+				// Scores, timer and the waiting label in one copy
+				hud.SetVisible(&waiting, session && !session->Connected());
+				++hudFrames;
+
+				// The pitch, then everything on it, over the whole window or
+				// just inside area
+				auto paint = [&](SDL_Rect const *area)
+				{
+					SDL_RenderCopy(renderer, texture, area, area);
 
-				// Draw the ball
-				ball.Draw(renderer);
+					// Draw the ball and the paddles
+					state.Each<Transform, SpriteId>([&](Transform const &position, SpriteId sprite)
+					{
+						sprites[static_cast<int>(sprite)]->Draw(renderer, position);
+					});
 
-				// Draw the paddles
-				paddleOneA.Draw(renderer);
-				paddleOneB.Draw(renderer);
-				paddleTwoA.Draw(renderer);
-				paddleTwoB.Draw(renderer);
+					if (quads > 0 && (!area || SDL_HasIntersection(area, &sparkBounds)))
+					{
+						auto drawStart = std::chrono::high_resolution_clock::now();
+						SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+						SDL_RenderGeometry(renderer, nullptr, reinterpret_cast<SDL_Vertex const *>(particles.Vertices()), 4 * quads,
+										   particles.Indices(), 6 * quads);
+						particleMs += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - drawStart).count();
+					}
 
-				// Display the scores
-				playerOneScoreText.Draw();
-				playerTwoScoreText.Draw();
+					hud.Draw(area);
 
-				timer.Draw();
+					if (player)
+					{
+						DrawScrubBar(renderer, player->Progress());
+					}
+				};
 
-				// Present the backbuffer
-				SDL_RenderPresent(renderer);
-				// Check if 90 seconds have elapsed
-				if (totalTime >= 90000) // 90 seconds in milliseconds 90000
+				if (dirtyMode)
+				{
+					// Where everything is this frame; what moved gets repainted
+					state.Each<Transform, SpriteId>([&](Transform const &position, SpriteId sprite)
+					{
+						SDL_Rect const &size = sprites[static_cast<int>(sprite)]->rect;
+						dirty.Drawn(DirtyRect{static_cast<int>(position.x), static_cast<int>(position.y), size.w, size.h});
+					});
+					if (quads > 0)
+					{
+						dirty.Drawn(DirtyRect{sparkBounds.x, sparkBounds.y, sparkBounds.w, sparkBounds.h});
+					}
+					hud.Track(dirty);
+					hud.Update();
+					if (player)
+					{
+						dirty.Mark(DirtyRect{SCRUB_X - 4, SCRUB_Y - 5, SCRUB_W + 8, SCRUB_H + 10});
+					}
+					dirty.Finish();
+
+					// Clipped, so nothing outside the rectangles is blended again
+					dirtyRects.clear();
+					for (DirtyRect const &rect : dirty.Rects())
+					{
+						SDL_Rect area{rect.x, rect.y, rect.w, rect.h};
+						SDL_RenderSetClipRect(renderer, &area);
+						paint(&area);
+						dirtyRects.push_back(area);
+					}
+					SDL_RenderSetClipRect(renderer, nullptr);
+					captureFrame();
+					SDL_UpdateWindowSurfaceRects(window, dirtyRects.data(), static_cast<int>(dirtyRects.size()));
+				}
+				else
 				{
-					// Trigger game reset
-					resetGame = true;
+					paint(nullptr);
+					captureFrame();
+
+					// Present the backbuffer
+					SDL_RenderPresent(renderer);
 				}
+				particles.Budget(particleMs, PARTICLE_BUDGET_MS);
 		}
 
+		if (firstFrame)
+		{
+			// Where startup went, in milliseconds
+			auto since = [](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+			{
+				return std::chrono::duration<float, std::milli>(to - from).count();
+			};
+			auto now = std::chrono::steady_clock::now();
+			firstFrame = false;
+			std::cout << "First frame after " << since(processStart, now) << " ms: setup " << since(processStart, sdlStart)
+					  << ", SDL " << since(sdlStart, assetsStart) << ", pack " << since(assetsStart, windowStart)
+					  << ", window and renderer " << since(windowStart, uploadStart)
+					  << ", waiting for decode " << decodeWaitMs << ", textures and font " << since(uploadStart, uploadEnd) - decodeWaitMs
+					  << ", first frame " << since(uploadEnd, now) << std::endl;
+			if (assets.DecodedCount() > 0)
+			{
+				std::cout << "Decoded " << assets.DecodedCount() << " PNGs on " << assets.Threads() << " threads in "
+						  << assets.DecodeMs() << " ms (" << assets.DecodeSumMs() << " ms one after another)" << std::endl;
+			}
+			else
+			{
+				std::cout << "All images came from the asset pack" << std::endl;
+			}
+		}
 
 		// Calculate frame time
 		auto stopTime = std::chrono::high_resolution_clock::now();
 		dt = std::chrono::duration<float, std::chrono::milliseconds::period>(stopTime - startTime).count();
-		totalTime += dt;
-		timer.SetText("Timer: "+ std::to_string(totalTime/1000).substr(0,4) + "s / 90s");
+		captureDueMs -= dt;
+		// Tenths of a second, so the text (and the HUD) changes ten times a
+		// second rather than every frame
+		int tenths = static_cast<int>(state.totalTime / 100);
+		if (player)
+		{
+			char const *speed = player->paused ? "paused" : player->speed == ReplayPlayer::Speed::Normal ? "1x"
+														: player->speed == ReplayPlayer::Speed::Fast	 ? "10x"
+																										 : "max";
+			timer.SetText(frameArena.Format("Replay: %d.%ds / 90s %s", tenths / 10, tenths % 10, speed));
+		}
+		else
+		{
+			timer.SetText(frameArena.Format("Timer: %d.%ds / 90s", tenths / 10, tenths % 10));
+		}
+
+		// Everything above that was only needed for this frame
+		frameArena.Reset();
 	}
 
+	std::cout << "Particles culled early: " << particles.Culled() << std::endl;
+	std::cout << "HUD redrawn " << hud.Redraws() << " times in " << hudFrames << " frames" << std::endl;
+	if (dirtyMode)
+	{
+		std::cout << "Dirty rectangles: " << 100.0f * dirty.PaintedFraction() << "% of the window repainted per frame, "
+				  << dirty.FullFrames() << " of " << dirty.Frames() << " frames in full" << std::endl;
+	}
+	std::cout << "Frame arena high-water mark: " << frameArena.HighWater() << " bytes, "
+			  << frameArena.Growths() << " heap blocks" << std::endl;
+
 	// Cleanup
+	if (audio)
+	{
+		SDL_CloseAudioDevice(audio);
+		std::cout << "Audio: " << mixer.FramesMixed() << " frames mixed, " << mixer.Dropped() << " sounds dropped, "
+				  << mixer.Stolen() << " voices stolen" << std::endl;
+	}
+	hotReload.Stop();
+	if (capture.IsOpen())
+	{
+		capture.Close();
+		std::cout << "Capture: " << capture.Written() << " frames written, " << capture.Dropped()
+				  << " dropped while the encoders were behind, " << capture.Failed() << " failed to write" << std::endl;
+	}
+	recorder.Close();
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
-	SDL_FreeSurface(image);
 	SDL_DestroyTexture(texture);
 	TTF_CloseFont(scoreFont);
 	TTF_Quit();
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+typedef int socklen_t;
+const SocketHandle NO_SOCKET = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+const SocketHandle NO_SOCKET = -1;
+#endif
+
+// Minimal non-blocking UDP for Windows and POSIX, plus a way to make a good
+// network look bad so netcode can be exercised over localhost.
+
+// Packets are little endian whatever the host is
+inline void Put16(uint8_t *out, uint16_t value)
+{
+	out[0] = static_cast<uint8_t>(value);
+	out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void Put32(uint8_t *out, uint32_t value)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		out[i] = static_cast<uint8_t>(value >> (8 * i));
+	}
+}
+
+inline uint16_t Get16(uint8_t const *in)
+{
+	return static_cast<uint16_t>(in[0] | (in[1] << 8));
+}
+
+inline uint32_t Get32(uint8_t const *in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+struct Endpoint
+{
+	sockaddr_in address{};
+	bool valid = false;
+
+	// "host" may be a name or a dotted address
+	static Endpoint Resolve(std::string const &host, uint16_t port)
+	{
+		Endpoint endpoint;
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+
+		addrinfo *found = nullptr;
+		if (getaddrinfo(host.c_str(), nullptr, &hints, &found) == 0 && found)
+		{
+			std::memcpy(&endpoint.address, found->ai_addr, sizeof(endpoint.address));
+			endpoint.address.sin_port = htons(port);
+			endpoint.valid = true;
+			freeaddrinfo(found);
+		}
+
+		return endpoint;
+	}
+
+	bool operator==(Endpoint const &rhs) const
+	{
+		return valid == rhs.valid && address.sin_addr.s_addr == rhs.address.sin_addr.s_addr &&
+			   address.sin_port == rhs.address.sin_port;
+	}
+};
+
+class UdpSocket
+{
+public:
+	UdpSocket()
+	{
+#ifdef _WIN32
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+		handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (handle == NO_SOCKET)
+		{
+			return;
+		}
+
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+		fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	}
+
+	~UdpSocket()
+	{
+		if (handle != NO_SOCKET)
+		{
+#ifdef _WIN32
+			closesocket(handle);
+			WSACleanup();
+#else
+			close(handle);
+#endif
+		}
+	}
+
+	UdpSocket(UdpSocket const &) = delete;
+	UdpSocket &operator=(UdpSocket const &) = delete;
+
+	// Port 0 picks a free one, see LocalPort
+	bool Bind(uint16_t port, char const *host = "0.0.0.0")
+	{
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		inet_pton(AF_INET, host, &address.sin_addr);
+
+		return handle != NO_SOCKET &&
+			   bind(handle, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	}
+
+	uint16_t LocalPort() const
+	{
+		sockaddr_in address{};
+		socklen_t length = sizeof(address);
+		getsockname(handle, reinterpret_cast<sockaddr *>(&address), &length);
+		return ntohs(address.sin_port);
+	}
+
+	bool Send(Endpoint const &to, uint8_t const *data, int size)
+	{
+		return sendto(handle, reinterpret_cast<char const *>(data), size, 0,
+					  reinterpret_cast<sockaddr const *>(&to.address), sizeof(to.address)) == size;
+	}
+
+	// Size of the datagram read, or -1 when nothing is waiting
+	int Receive(uint8_t *data, int capacity, Endpoint &from)
+	{
+		socklen_t length = sizeof(from.address);
+		int size = static_cast<int>(recvfrom(handle, reinterpret_cast<char *>(data), capacity, 0,
+											 reinterpret_cast<sockaddr *>(&from.address), &length));
+		from.valid = size >= 0;
+		return size;
+	}
+
+	bool IsOpen() const { return handle != NO_SOCKET; }
+
+	// For epoll and batched sends
+	SocketHandle Handle() const { return handle; }
+
+private:
+	SocketHandle handle = NO_SOCKET;
+};
+
+struct LinkConditions
+{
+	float latencyMs = 0.0f; // one way
+	float jitterMs = 0.0f;
+	float lossRate = 0.0f;  // 0..1
+	uint32_t seed = 1;
+};
+
+// Outgoing side of a socket with simulated latency, jitter and loss. Packets
+// wait in a queue until their delivery time and go out on a later Send or
+// Receive call. With default conditions it is a plain pass-through.
+class NetLink
+{
+public:
+	NetLink(UdpSocket &socket, LinkConditions conditions = LinkConditions())
+		: socket(socket), conditions(conditions), random(conditions.seed)
+	{
+		clock = []()
+		{
+			using namespace std::chrono;
+			return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+		};
+	}
+
+	void Send(Endpoint const &to, uint8_t const *data, int size)
+	{
+		++sent;
+		bytesSent += size;
+
+		if (conditions.lossRate > 0.0f && std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < conditions.lossRate)
+		{
+			++dropped;
+			return;
+		}
+
+		if (conditions.latencyMs <= 0.0f && conditions.jitterMs <= 0.0f)
+		{
+			socket.Send(to, data, size);
+			return;
+		}
+
+		double delay = conditions.latencyMs;
+		if (conditions.jitterMs > 0.0f)
+		{
+			delay += std::uniform_real_distribution<float>(0.0f, conditions.jitterMs)(random);
+		}
+		queue.push_back({clock() + delay, to, std::vector<uint8_t>(data, data + size)});
+		Flush();
+	}
+
+	int Receive(uint8_t *data, int capacity, Endpoint &from)
+	{
+		Flush();
+		return socket.Receive(data, capacity, from);
+	}
+
+	// Send everything whose time has come. Jitter can reorder packets, the
+	// same as a real network.
+	void Flush()
+	{
+		double now = clock();
+		for (auto it = queue.begin(); it != queue.end();)
+		{
+			if (it->due <= now)
+			{
+				socket.Send(it->to, it->data.data(), static_cast<int>(it->data.size()));
+				it = queue.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+	// Milliseconds; replace to run a simulated network on virtual time
+	std::function<double()> clock;
+
+	uint64_t sent = 0;
+	uint64_t dropped = 0;
+	uint64_t bytesSent = 0;
+
+private:
+	struct Pending
+	{
+		double due;
+		Endpoint to;
+		std::vector<uint8_t> data;
+	};
+
+	UdpSocket &socket;
+	LinkConditions conditions;
+	std::mt19937 random;
+	std::deque<Pending> queue;
+};
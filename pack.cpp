@@ -0,0 +1,102 @@
+// Builds the asset pack the game loads at startup (see pack.h). Run it
+// again whenever a file in assets/ changes.
+//
+//   pack                              assets/ into assets/tinyball.pack
+//   pack --assets DIR --out FILE
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "pack.h"
+
+// Everything the game draws, relative to the assets directory
+const char *const IMAGES[] = {"football-pitch.png", "ball.png", "blue/image_part_004.png", "red/image.png"};
+const char *const BLOBS[] = {"DejaVuSansMono.ttf"};
+
+int main(int argc, char *argv[])
+{
+	std::string assets = "./assets";
+	std::string out;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (flag == "--assets" && i + 1 < argc)
+		{
+			assets = argv[++i];
+		}
+		else if (flag == "--out" && i + 1 < argc)
+		{
+			out = argv[++i];
+		}
+		else
+		{
+			std::printf("Usage: pack [--assets DIR] [--out FILE]\n");
+			return 1;
+		}
+	}
+
+	if (out.empty())
+	{
+		out = assets + "/" + PACK_NAME;
+	}
+
+	PackWriter writer;
+	size_t pixelBytes = 0;
+	for (char const *name : IMAGES)
+	{
+		std::string path = assets + "/" + name;
+		SDL_Surface *loaded = IMG_Load(path.c_str());
+		if (!loaded)
+		{
+			std::printf("Cannot load %s: %s\n", path.c_str(), IMG_GetError());
+			return 1;
+		}
+
+		// Stored the way the texture will hold it, so loading is a copy
+		SDL_Surface *rgba = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+		SDL_FreeSurface(loaded);
+		if (!rgba)
+		{
+			std::printf("Cannot convert %s: %s\n", path.c_str(), SDL_GetError());
+			return 1;
+		}
+		SDL_LockSurface(rgba);
+		writer.AddImage(name, rgba->w, rgba->h, rgba->pitch, rgba->pixels);
+		SDL_UnlockSurface(rgba);
+		pixelBytes += static_cast<size_t>(rgba->pitch) * rgba->h;
+		std::printf("%-28s %5d x %-5d\n", name, rgba->w, rgba->h);
+		SDL_FreeSurface(rgba);
+	}
+
+	for (char const *name : BLOBS)
+	{
+		std::string path = assets + "/" + name;
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			std::printf("Cannot open %s\n", path.c_str());
+			return 1;
+		}
+		std::vector<uint8_t> bytes;
+		uint8_t buffer[1 << 16];
+		size_t got;
+		while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			bytes.insert(bytes.end(), buffer, buffer + got);
+		}
+		std::fclose(file);
+		writer.AddBlob(name, bytes.data(), bytes.size());
+		std::printf("%-28s %zu bytes\n", name, bytes.size());
+	}
+
+	if (!writer.Save(out))
+	{
+		std::printf("Cannot write %s\n", out.c_str());
+		return 1;
+	}
+	std::printf("Wrote %s: %zu entries, %zu bytes of pixels\n", out.c_str(), writer.Count(), pixelBytes);
+	return 0;
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h> // net.h needs it included ahead of windows.h
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "net.h"
+
+// Asset pack: every image the game draws, already decoded to RGBA pixels,
+// plus the font, in one file. The game maps the file and hands the pixels
+// straight to SDL_UpdateTexture, so startup does no PNG decoding and opens
+// one file instead of one per asset. `pack` (pack.cpp) writes it.
+//
+//   header   "TBPK" version:16 entries:16
+//   entry    name:32 bytes, NUL padded  kind:32 width:32 height:32 pitch:32 offset:32 size:32
+//   data     each entry's bytes, starting on a PACK_ALIGN boundary
+//
+// Image pixels are rows of R, G, B, A bytes (SDL_PIXELFORMAT_RGBA32).
+
+const uint32_t PACK_MAGIC = 0x4B504254; // "TBPK"
+const uint16_t PACK_VERSION = 1;
+const int PACK_HEADER_SIZE = 8;
+const int PACK_NAME_SIZE = 32;
+const int PACK_ENTRY_SIZE = PACK_NAME_SIZE + 6 * 4;
+const uint32_t PACK_ALIGN = 64;
+const char *const PACK_NAME = "tinyball.pack"; // in the assets directory
+
+enum class PackKind : uint32_t
+{
+	Image,
+	Blob // anything else, stored as it was (the font)
+};
+
+// A file built into the executable (embed.cpp writes the table, ended by
+// a null name)
+struct EmbeddedFile
+{
+	char const *name;
+	unsigned char const *data;
+	size_t size;
+};
+
+struct PackEntry
+{
+	std::string name;
+	PackKind kind;
+	int width, height, pitch;
+	uint32_t offset, size;
+};
+
+// A read only view of a whole file, shared with the page cache
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	bool Open(std::string const &path)
+	{
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			return false;
+		}
+		LARGE_INTEGER length;
+		if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+		{
+			Close();
+			return false;
+		}
+		size = static_cast<size_t>(length.QuadPart);
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			Close();
+			return false;
+		}
+		memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			close(fd);
+			return false;
+		}
+		size = static_cast<size_t>(info.st_size);
+		memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+		{
+			memory = nullptr;
+		}
+#endif
+		return memory != nullptr;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (memory)
+		{
+			UnmapViewOfFile(memory);
+		}
+		if (mapping)
+		{
+			CloseHandle(mapping);
+		}
+		if (file)
+		{
+			CloseHandle(file);
+		}
+		mapping = nullptr;
+		file = nullptr;
+#else
+		if (memory)
+		{
+			munmap(memory, size);
+		}
+#endif
+		memory = nullptr;
+		size = 0;
+	}
+
+	uint8_t const *Data() const { return static_cast<uint8_t const *>(memory); }
+	size_t Size() const { return size; }
+
+private:
+	void *memory = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file = nullptr;
+	HANDLE mapping = nullptr;
+#endif
+};
+
+// An open pack. Entry data points into the mapping, or the memory the
+// pack was opened on, and stays valid until the pack is closed or destroyed.
+class AssetPack
+{
+public:
+	// Empty string on success, otherwise what is wrong with the file
+	std::string Open(std::string const &path)
+	{
+		entries.clear();
+		bytes = nullptr;
+		if (!file.Open(path))
+		{
+			return "cannot open " + path;
+		}
+		return Open(file.Data(), file.Size());
+	}
+
+	// A pack already in memory, such as one built into the executable. The
+	// memory must outlive the pack.
+	std::string Open(uint8_t const *data, size_t size)
+	{
+		entries.clear();
+		bytes = nullptr;
+		if (size < PACK_HEADER_SIZE || Get32(data) != PACK_MAGIC)
+		{
+			return "not an asset pack";
+		}
+		if (Get16(data + 4) != PACK_VERSION)
+		{
+			return "unsupported asset pack version";
+		}
+
+		int count = Get16(data + 6);
+		if (size < PACK_HEADER_SIZE + static_cast<size_t>(count) * PACK_ENTRY_SIZE)
+		{
+			return "asset pack is truncated";
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			uint8_t const *at = data + PACK_HEADER_SIZE + i * PACK_ENTRY_SIZE;
+			PackEntry entry;
+			entry.name.assign(reinterpret_cast<char const *>(at), strnlen(reinterpret_cast<char const *>(at), PACK_NAME_SIZE));
+			at += PACK_NAME_SIZE;
+			entry.kind = static_cast<PackKind>(Get32(at));
+			entry.width = static_cast<int>(Get32(at + 4));
+			entry.height = static_cast<int>(Get32(at + 8));
+			entry.pitch = static_cast<int>(Get32(at + 12));
+			entry.offset = Get32(at + 16);
+			entry.size = Get32(at + 20);
+			if (static_cast<size_t>(entry.offset) + entry.size > size ||
+				(entry.kind == PackKind::Image && static_cast<size_t>(entry.pitch) * entry.height > entry.size))
+			{
+				entries.clear();
+				return "asset pack entry " + entry.name + " is damaged";
+			}
+			entries.push_back(entry);
+		}
+		bytes = data;
+		return "";
+	}
+
+	bool IsOpen() const { return bytes != nullptr; }
+
+	// The entry called name, or null
+	PackEntry const *Find(std::string const &name) const
+	{
+		for (PackEntry const &entry : entries)
+		{
+			if (entry.name == name)
+			{
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	uint8_t const *Data(PackEntry const &entry) const { return bytes + entry.offset; }
+
+	std::vector<PackEntry> const &Entries() const { return entries; }
+
+private:
+	MappedFile file;
+	uint8_t const *bytes = nullptr;
+	std::vector<PackEntry> entries;
+};
+
+// Builds a pack in memory and writes it out in one go
+class PackWriter
+{
+public:
+	void AddImage(std::string const &name, int width, int height, int pitch, void const *pixels)
+	{
+		Add(name, PackKind::Image, width, height, pitch, pixels, static_cast<size_t>(pitch) * height);
+	}
+
+	void AddBlob(std::string const &name, void const *bytes, size_t size)
+	{
+		Add(name, PackKind::Blob, 0, 0, 0, bytes, size);
+	}
+
+	bool Save(std::string const &path) const
+	{
+		std::vector<uint8_t> out(PACK_HEADER_SIZE + entries.size() * PACK_ENTRY_SIZE);
+		Put32(&out[0], PACK_MAGIC);
+		Put16(&out[4], PACK_VERSION);
+		Put16(&out[6], static_cast<uint16_t>(entries.size()));
+
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			PackEntry const &entry = entries[i];
+			out.resize((out.size() + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN);
+			uint32_t offset = static_cast<uint32_t>(out.size());
+			out.insert(out.end(), blobs[i].begin(), blobs[i].end());
+
+			uint8_t *at = &out[PACK_HEADER_SIZE + i * PACK_ENTRY_SIZE];
+			std::strncpy(reinterpret_cast<char *>(at), entry.name.c_str(), PACK_NAME_SIZE);
+			at += PACK_NAME_SIZE;
+			Put32(at, static_cast<uint32_t>(entry.kind));
+			Put32(at + 4, static_cast<uint32_t>(entry.width));
+			Put32(at + 8, static_cast<uint32_t>(entry.height));
+			Put32(at + 12, static_cast<uint32_t>(entry.pitch));
+			Put32(at + 16, offset);
+			Put32(at + 20, entry.size);
+		}
+
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+		return std::fclose(file) == 0 && written;
+	}
+
+	size_t Count() const { return entries.size(); }
+
+private:
+	void Add(std::string const &name, PackKind kind, int width, int height, int pitch, void const *bytes, size_t size)
+	{
+		PackEntry entry{name.substr(0, PACK_NAME_SIZE - 1), kind, width, height, pitch, 0, static_cast<uint32_t>(size)};
+		entries.push_back(entry);
+		uint8_t const *from = static_cast<uint8_t const *>(bytes);
+		blobs.emplace_back(from, from + size);
+	}
+
+	std::vector<PackEntry> entries;
+	std::vector<std::vector<uint8_t>> blobs;
+};
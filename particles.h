@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "game.h"
+
+// Sparks for paddle hits and goals. Particles live in a fixed ring of
+// structure-of-arrays slots, oldest first, so integrating them is a straight
+// walk over a few float arrays and getting rid of the oldest is moving the
+// head. Everything is allocated up front; emitting, updating and building
+// the vertex buffer never touch the heap. Nothing here depends on SDL: the
+// vertices have SDL_Vertex's layout and the front end draws them all with
+// one SDL_RenderGeometry call.
+
+const int MAX_PARTICLES = 65536;
+const float PARTICLE_SIZE = 4.0f;    // pixels across
+const float PARTICLE_DRAG = 0.0025f; // fraction of the speed lost per millisecond
+const int PARTICLE_MIN_LIMIT = 1024; // the budget never cuts below this many
+
+// Same layout as SDL_Vertex
+struct ParticleVertex
+{
+	float x, y;
+	uint8_t r, g, b, a;
+	float u, v;
+};
+
+struct Burst
+{
+	float x, y;       // centre in field pixels
+	float directionX; // +1 or -1 sprays to that side, 0 all round
+	int count;
+	float speed;    // fastest particle, pixels per millisecond
+	float lifeMs;   // average; each particle gets +-25%
+	uint8_t r, g, b;
+};
+
+class ParticlePool
+{
+public:
+	// capacity is rounded up to a power of two
+	explicit ParticlePool(int capacity = MAX_PARTICLES)
+	{
+		size = 1;
+		while (size < capacity)
+		{
+			size *= 2;
+		}
+		mask = size - 1;
+		limit = size;
+
+		x.resize(size);
+		y.resize(size);
+		velocityX.resize(size);
+		velocityY.resize(size);
+		age.resize(size);
+		life.resize(size);
+		color.resize(size);
+		vertices.resize(4 * size);
+
+		// Every particle is a quad of two triangles, so the indices never change
+		indices.resize(6 * size);
+		for (int i = 0; i < size; ++i)
+		{
+			int quad = 4 * i;
+			int *index = &indices[6 * i];
+			index[0] = quad;
+			index[1] = quad + 1;
+			index[2] = quad + 2;
+			index[3] = quad + 2;
+			index[4] = quad + 3;
+			index[5] = quad;
+		}
+	}
+
+	ParticlePool(ParticlePool const &) = delete;
+	ParticlePool &operator=(ParticlePool const &) = delete;
+
+	// Starts every particle of the burst; when the pool is at its limit the
+	// oldest particles make room
+	void Emit(Burst const &burst)
+	{
+		const float PI = 3.14159265f;
+		float spread = burst.directionX == 0.0f ? PI : 0.4f * PI;
+		float facing = burst.directionX < 0.0f ? PI : 0.0f;
+
+		for (int i = 0; i < burst.count; ++i)
+		{
+			if (count >= limit)
+			{
+				Cull(limit - 1);
+			}
+
+			float angle = facing + spread * (2.0f * Random() - 1.0f);
+			float speed = burst.speed * (0.2f + 0.8f * Random());
+			float shade = 0.75f + 0.25f * Random();
+
+			int slot = (head + count) & mask;
+			x[slot] = burst.x;
+			y[slot] = burst.y;
+			velocityX[slot] = speed * std::cos(angle);
+			velocityY[slot] = speed * std::sin(angle);
+			age[slot] = 0.0f;
+			life[slot] = burst.lifeMs * (0.75f + 0.5f * Random());
+			color[slot] = static_cast<uint32_t>(burst.r * shade) |
+						  static_cast<uint32_t>(burst.g * shade) << 8 |
+						  static_cast<uint32_t>(burst.b * shade) << 16;
+			++count;
+		}
+	}
+
+	// Move everything on by dtMs and forget the particles that have died at
+	// the old end of the ring. Ones that die further in are skipped when
+	// drawing until they reach the head.
+	void Update(float dtMs)
+	{
+		float keep = 1.0f - PARTICLE_DRAG * dtMs;
+		keep = keep < 0.0f ? 0.0f : keep;
+
+		int first = count < size - head ? count : size - head;
+		Integrate(head, head + first, dtMs, keep);
+		Integrate(0, count - first, dtMs, keep);
+
+		while (count > 0 && age[head] >= life[head])
+		{
+			head = (head + 1) & mask;
+			--count;
+		}
+	}
+
+	// Fill the vertex buffer, oldest particles first so new sparks are drawn
+	// on top. Returns how many quads it holds: draw 4 * n Vertices() with
+	// the first 6 * n Indices().
+	int BuildVertices()
+	{
+		const float HALF = PARTICLE_SIZE / 2.0f;
+		int quads = 0;
+		float lowX = 1e30f, lowY = 1e30f, highX = -1e30f, highY = -1e30f;
+		for (int k = 0; k < count; ++k)
+		{
+			int i = (head + k) & mask;
+			float left = 1.0f - age[i] / life[i];
+			if (left <= 0.0f)
+			{
+				continue;
+			}
+
+			uint8_t r = static_cast<uint8_t>(color[i]);
+			uint8_t g = static_cast<uint8_t>(color[i] >> 8);
+			uint8_t b = static_cast<uint8_t>(color[i] >> 16);
+			uint8_t a = static_cast<uint8_t>(255.0f * left);
+
+			ParticleVertex *quad = &vertices[4 * quads++];
+			quad[0] = {x[i] - HALF, y[i] - HALF, r, g, b, a, 0.0f, 0.0f};
+			quad[1] = {x[i] + HALF, y[i] - HALF, r, g, b, a, 0.0f, 0.0f};
+			quad[2] = {x[i] + HALF, y[i] + HALF, r, g, b, a, 0.0f, 0.0f};
+			quad[3] = {x[i] - HALF, y[i] + HALF, r, g, b, a, 0.0f, 0.0f};
+			lowX = x[i] < lowX ? x[i] : lowX;
+			lowY = y[i] < lowY ? y[i] : lowY;
+			highX = x[i] > highX ? x[i] : highX;
+			highY = y[i] > highY ? y[i] : highY;
+		}
+		bounds[0] = lowX - HALF;
+		bounds[1] = lowY - HALF;
+		bounds[2] = highX + HALF;
+		bounds[3] = highY + HALF;
+		return quads;
+	}
+
+	// Smallest box around the quads of the last BuildVertices, as left, top,
+	// right, bottom. Empty (left > right) when it built none.
+	float const *Bounds() const { return bounds; }
+
+	ParticleVertex const *Vertices() const { return vertices.data(); }
+	int const *Indices() const { return indices.data(); }
+
+	// Called once a frame with how long the particles took (update, build
+	// and draw). Over budget the limit drops to what fits and the oldest
+	// particles go, so a big goal burst thins out instead of costing frames;
+	// under budget the limit creeps back up.
+	void Budget(float spentMs, float budgetMs)
+	{
+		if (spentMs > budgetMs && count > PARTICLE_MIN_LIMIT)
+		{
+			int fits = static_cast<int>(count * (budgetMs / spentMs) * 0.9f);
+			limit = fits < PARTICLE_MIN_LIMIT ? PARTICLE_MIN_LIMIT : fits;
+			Cull(limit);
+		}
+		else if (limit < size)
+		{
+			limit = limit + size / 64 > size ? size : limit + size / 64;
+		}
+	}
+
+	// Drop the oldest particles until at most keep are left
+	void Cull(int keep)
+	{
+		keep = keep < 0 ? 0 : keep;
+		if (count > keep)
+		{
+			culled += count - keep;
+			head = (head + count - keep) & mask;
+			count = keep;
+		}
+	}
+
+	void Clear()
+	{
+		head = 0;
+		count = 0;
+	}
+
+	int Count() const { return count; }
+	int Capacity() const { return size; }
+	int Limit() const { return limit; }
+
+	// Particles removed before they had faded out
+	long long Culled() const { return culled; }
+
+private:
+	// Slots [begin, end) of the ring, which do not wrap
+	void Integrate(int begin, int end, float dtMs, float keep)
+	{
+		int i = begin;
+#if defined(__SSE2__)
+		__m128 step = _mm_set1_ps(dtMs);
+		__m128 damp = _mm_set1_ps(keep);
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 vx = _mm_loadu_ps(&velocityX[i]);
+			__m128 vy = _mm_loadu_ps(&velocityY[i]);
+			_mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(vx, step)));
+			_mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(vy, step)));
+			_mm_storeu_ps(&velocityX[i], _mm_mul_ps(vx, damp));
+			_mm_storeu_ps(&velocityY[i], _mm_mul_ps(vy, damp));
+			_mm_storeu_ps(&age[i], _mm_add_ps(_mm_loadu_ps(&age[i]), step));
+		}
+#endif
+		for (; i < end; ++i)
+		{
+			x[i] += velocityX[i] * dtMs;
+			y[i] += velocityY[i] * dtMs;
+			velocityX[i] *= keep;
+			velocityY[i] *= keep;
+			age[i] += dtMs;
+		}
+	}
+
+	// xorshift; looks only, never touches the simulation
+	float Random()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return (seed >> 8) * (1.0f / 16777216.0f);
+	}
+
+	std::vector<float> x, y;
+	std::vector<float> velocityX, velocityY;
+	std::vector<float> age, life;
+	std::vector<uint32_t> color; // r | g << 8 | b << 16
+	std::vector<ParticleVertex> vertices;
+	std::vector<int> indices;
+	int size = 0;
+	int mask = 0;
+	int head = 0; // oldest particle
+	int count = 0;
+	int limit = 0;
+	long long culled = 0;
+	float bounds[4] = {1.0f, 1.0f, 0.0f, 0.0f};
+	uint32_t seed = 2463534242U;
+};
+
+// The burst for something the ball did. ball is where it was before the
+// tick (a goal puts it back on the centre spot), velocity where it is
+// heading after. Returns a burst of zero particles for anything else.
+inline Burst EventBurst(MatchEvent event, Transform const &ball, Velocity const &velocity)
+{
+	float centreY = static_cast<float>(ball.y) + BALL_HEIGHT / 2.0f;
+	if (event == MatchEvent::PaddleHit)
+	{
+		float centreX = static_cast<float>(ball.x) + BALL_WIDTH / 2.0f;
+		return Burst{centreX, centreY, velocity.x < 0.0f ? -1.0f : 1.0f, 150, 0.5f, 400.0f, 0xFF, 0xF0, 0xA0};
+	}
+	if (event == MatchEvent::GoalOne)
+	{
+		// Blue scored on the right
+		return Burst{static_cast<float>(WIDTH), centreY, -1.0f, 2500, 0.9f, 1200.0f, 0x30, 0x60, 0xFF};
+	}
+	if (event == MatchEvent::GoalTwo)
+	{
+		return Burst{0.0f, centreY, 1.0f, 2500, 0.9f, 1200.0f, 0xE0, 0x30, 0x30};
+	}
+	return Burst{0.0f, 0.0f, 0.0f, 0, 0.0f, 0.0f, 0, 0, 0};
+}
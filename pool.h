@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that all run the same job once per Run call, each with
+// its own index. The calling thread does index 0 itself, so a pool of one has
+// no threads at all and costs nothing.
+class WorkerPool
+{
+public:
+	explicit WorkerPool(int size)
+	{
+		for (int t = 1; t < size; ++t)
+		{
+			workers.emplace_back([this, t]() { Work(t); });
+		}
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	WorkerPool(WorkerPool const &) = delete;
+	WorkerPool &operator=(WorkerPool const &) = delete;
+
+	int Size() const { return static_cast<int>(workers.size()) + 1; }
+
+	// Calls job(t) for every t in [0, Size()) and returns once all are done
+	void Run(std::function<void(int)> const &next)
+	{
+		job = &next;
+
+		if (!workers.empty())
+		{
+			pending = static_cast<int>(workers.size());
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				++generation;
+			}
+			wake.notify_all();
+		}
+
+		next(0);
+
+		if (!workers.empty())
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			idle.wait(lock, [this]() { return pending.load() == 0; });
+		}
+	}
+
+private:
+	void Work(int t)
+	{
+		uint64_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping)
+				{
+					return;
+				}
+				seen = generation;
+			}
+
+			(*job)(t);
+
+			if (--pending == 0)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				idle.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	uint64_t generation = 0;
+	std::atomic<int> pending{0};
+	bool stopping = false;
+	std::function<void(int)> const *job = nullptr;
+};
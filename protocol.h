@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "game.h"
+#include "net.h"
+#include "snapshot.h"
+
+// Wire format between the match server and its clients. Every datagram starts
+// with the magic and a type byte. A client is known by its address, so after
+// joining it only sends its input bits and the last state tick it received;
+// the server answers every few ticks with a snapshot delta encoded against
+// that tick (see snapshot.h).
+//
+//   Join     client -> server  magic type
+//   Welcome  server -> client  magic type team
+//   Input    client -> server  magic type bits ack:32
+//   State    server -> client  magic type snapshot
+
+const uint32_t SERVER_MAGIC = 0x32534254; // "TBS2"
+const uint16_t SERVER_PORT = 7778;
+
+enum class PacketType : uint8_t
+{
+	Join = 1,
+	Welcome,
+	Input,
+	State
+};
+
+const int PACKET_HEADER_SIZE = 5;
+const int WELCOME_SIZE = PACKET_HEADER_SIZE + 1;
+const int INPUT_SIZE = PACKET_HEADER_SIZE + 5;
+const int MAX_STATE_SIZE = PACKET_HEADER_SIZE + MAX_SNAPSHOT_BYTES;
+
+inline void PutHeader(uint8_t *out, PacketType type)
+{
+	Put32(out, SERVER_MAGIC);
+	out[4] = static_cast<uint8_t>(type);
+}
+
+// PacketType of a datagram, or 0 when it is not one of ours
+inline uint8_t ReadHeader(uint8_t const *in, int size)
+{
+	return size >= PACKET_HEADER_SIZE && Get32(in) == SERVER_MAGIC ? in[4] : 0;
+}
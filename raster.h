@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "game.h"
+
+// Low resolution picture of a match drawn on the CPU, for training and tests
+// that have no GPU. Nothing goes through SDL. The static field is prepared
+// once and copied into every frame, then the ball and every paddle are
+// filled span by span.
+
+struct Shade
+{
+	uint8_t r, g, b;
+	uint8_t gray; // picked by hand so every element stays distinct in gray
+};
+
+const Shade FIELD_SHADE{0x2E, 0x7D, 0x32, 0x40};
+const Shade LINE_SHADE{0xE0, 0xE0, 0xE0, 0x70};
+const Shade BLUE_SHADE{0x30, 0x60, 0xFF, 0xA0};
+const Shade RED_SHADE{0xE0, 0x30, 0x30, 0xC8};
+const Shade BALL_SHADE{0xFF, 0xFF, 0xFF, 0xFF};
+
+class Rasterizer
+{
+public:
+	// channels is 1 for gray, 3 for RGB
+	Rasterizer(int width = 84, int height = 84, int channels = 1)
+		: width(width), height(height), channels(channels),
+		  scaleX(static_cast<float>(width) / WIDTH), scaleY(static_cast<float>(height) / HEIGHT),
+		  background(FrameBytes())
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			FillSpan(&background[y * Pitch()], 0, width, FIELD_SHADE);
+		}
+
+		// Halfway line
+		FillRect(background.data(), WIDTH / 2.0f - 1.0f, 0.0f, 2.0f, HEIGHT, LINE_SHADE);
+	}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	int Channels() const { return channels; }
+	int Pitch() const { return width * channels; }
+	int FrameBytes() const { return width * height * channels; }
+
+	// Writes FrameBytes() bytes, rows top to bottom with no padding
+	void Draw(Match const &match, uint8_t *frame) const
+	{
+		std::memcpy(frame, background.data(), background.size());
+
+		// Paddles first so the ball stays visible on top of them
+		auto draw = [&](Transform const &position, Collider const &box, SpriteId sprite)
+		{
+			Shade const &shade = sprite == SpriteId::Blue ? BLUE_SHADE : sprite == SpriteId::Red ? RED_SHADE : BALL_SHADE;
+			FillRect(frame, static_cast<float>(position.x), static_cast<float>(position.y),
+					 static_cast<float>(box.width), static_cast<float>(box.height), shade);
+		};
+		EachEntity<Transform, Collider, SpriteId>(draw, match.paddles, match.balls);
+	}
+
+private:
+	// Field coordinates in, clipped pixel rectangle out. Anything on screen
+	// covers at least one pixel so a small ball never vanishes.
+	void FillRect(uint8_t *frame, float x, float y, float w, float h, Shade const &shade) const
+	{
+		int x0 = static_cast<int>(std::lround(x * scaleX));
+		int x1 = static_cast<int>(std::lround((x + w) * scaleX));
+		int y0 = static_cast<int>(std::lround(y * scaleY));
+		int y1 = static_cast<int>(std::lround((y + h) * scaleY));
+
+		if (x1 <= x0)
+		{
+			x1 = x0 + 1;
+		}
+		if (y1 <= y0)
+		{
+			y1 = y0 + 1;
+		}
+
+		x0 = x0 < 0 ? 0 : x0;
+		y0 = y0 < 0 ? 0 : y0;
+		x1 = x1 > width ? width : x1;
+		y1 = y1 > height ? height : y1;
+
+		for (int row = y0; row < y1; ++row)
+		{
+			FillSpan(frame + row * Pitch(), x0, x1, shade);
+		}
+	}
+
+	void FillSpan(uint8_t *row, int x0, int x1, Shade const &shade) const
+	{
+		if (x1 <= x0)
+		{
+			return;
+		}
+
+		if (channels == 1)
+		{
+			std::memset(row + x0, shade.gray, x1 - x0);
+			return;
+		}
+
+		uint8_t *out = row + x0 * 3;
+		int pixels = x1 - x0;
+
+#if defined(__SSE2__)
+		// 16 RGB pixels are exactly three 16 byte stores
+		if (pixels >= 16)
+		{
+			alignas(16) uint8_t pattern[48];
+			for (int i = 0; i < 16; ++i)
+			{
+				pattern[i * 3 + 0] = shade.r;
+				pattern[i * 3 + 1] = shade.g;
+				pattern[i * 3 + 2] = shade.b;
+			}
+			__m128i a = _mm_load_si128(reinterpret_cast<__m128i const *>(pattern));
+			__m128i b = _mm_load_si128(reinterpret_cast<__m128i const *>(pattern + 16));
+			__m128i c = _mm_load_si128(reinterpret_cast<__m128i const *>(pattern + 32));
+
+			for (; pixels >= 16; pixels -= 16, out += 48)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out), a);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), b);
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 32), c);
+			}
+		}
+#endif
+
+		for (; pixels > 0; --pixels, out += 3)
+		{
+			out[0] = shade.r;
+			out[1] = shade.g;
+			out[2] = shade.b;
+		}
+	}
+
+	int width;
+	int height;
+	int channels;
+	float scaleX;
+	float scaleY;
+	std::vector<uint8_t> background;
+};
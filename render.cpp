@@ -0,0 +1,256 @@
+// Renders replays to Y4M video on the CPU (see tiles.h), several replays at
+// once, one per core.
+//
+//   render a.tbr b.tbr ...            a.y4m, b.y4m in the current directory
+//   render --out DIR                  write the videos into DIR
+//   render --size 640x360             scale every frame down (or up)
+//   render --speed 2 --fps 30         match time per second of video, frame rate
+//   render --highlights 5             only 5 s around each goal, a.goal1.y4m ...
+//   render --jobs N                   replays at a time, every core by default
+//   render --pack FILE                the art from this asset pack
+//
+// Highlights find their goals from the scores in the replay's keyframes and
+// start each clip from the keyframe before it, so a clip costs its own
+// length plus at most one keyframe interval of simulation.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "capture.h"
+#include "pack.h"
+#include "pool.h"
+#include "replay.h"
+#include "tiles.h"
+
+struct Settings
+{
+	std::string out = ".";
+	int width = WIDTH;
+	int height = HEIGHT;
+	float speed = 1.0f;
+	int fps = CAPTURE_FPS;
+	float highlights = 0.0f; // seconds per clip, 0 for whole matches
+};
+
+// One replay's worth of work, done on one thread of the pool
+class ReplayJob
+{
+public:
+	ReplayJob(Settings const &settings, AssetPack const &pack, int threads)
+		: settings(settings), renderer(threads), canvas(&pack),
+		  full(static_cast<size_t>(WIDTH) * HEIGHT * 4),
+		  scaled(static_cast<size_t>(settings.width) * settings.height * 4),
+		  yuv(static_cast<size_t>(settings.width) * settings.height +
+			  2 * static_cast<size_t>((settings.width + 1) / 2) * ((settings.height + 1) / 2))
+	{
+		canvas.SetBackground(renderer);
+	}
+
+	// Returns how many frames it wrote, or -1 after printing what went wrong
+	long long Run(std::string const &path)
+	{
+		ReplayReader reader;
+		std::string error = reader.Open(path);
+		if (!error.empty())
+		{
+			std::printf("%s: %s\n", path.c_str(), error.c_str());
+			return -1;
+		}
+
+		size_t slash = path.find_last_of("/\\");
+		std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+		name = name.substr(0, name.rfind('.'));
+		std::string base = settings.out + "/" + name;
+
+		if (settings.highlights <= 0.0f)
+		{
+			return Write(reader, base + ".y4m", 0, reader.TickCount());
+		}
+
+		long long frames = 0;
+		int around = static_cast<int>(settings.highlights * 1000.0f / TICK_MS / 2);
+		std::vector<int> goals = reader.GoalTicks();
+		for (size_t n = 0; n < goals.size(); ++n)
+		{
+			int from = std::max(goals[n] - around, 0);
+			int to = std::min(goals[n] + around, reader.TickCount());
+			long long written = Write(reader, base + ".goal" + std::to_string(n + 1) + ".y4m", from, to);
+			if (written < 0)
+			{
+				return -1;
+			}
+			frames += written;
+		}
+		if (goals.empty())
+		{
+			std::printf("%s: no goals\n", path.c_str());
+		}
+		return frames;
+	}
+
+private:
+	// Ticks [from, to) as one video
+	long long Write(ReplayReader const &reader, std::string const &path, int from, int to)
+	{
+		std::FILE *file = std::fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			std::printf("Cannot write %s\n", path.c_str());
+			return -1;
+		}
+		std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", settings.width, settings.height, settings.fps);
+
+		float msPerFrame = settings.speed * 1000.0f / settings.fps;
+		float owed = 0.0f;
+		long long frames = 0;
+		bool ok = true;
+		Match match = reader.Seek(from);
+		for (int tick = from; ok && tick < to; ++frames)
+		{
+			canvas.Queue(renderer, match);
+			renderer.Render(full.data());
+			uint8_t const *pixels = full.data();
+			if (settings.width != WIDTH || settings.height != HEIGHT)
+			{
+				Scale();
+				pixels = scaled.data();
+			}
+			RgbaToI420(pixels, settings.width, settings.height, yuv.data());
+			ok = std::fwrite("FRAME\n", 6, 1, file) == 1 && std::fwrite(yuv.data(), yuv.size(), 1, file) == 1;
+
+			for (owed += msPerFrame; owed >= TICK_MS && tick < to; owed -= TICK_MS)
+			{
+				reader.Step(match, tick++);
+			}
+		}
+
+		if (std::fclose(file) != 0 || !ok)
+		{
+			std::printf("Cannot write %s\n", path.c_str());
+			return -1;
+		}
+		return frames;
+	}
+
+	// Nearest neighbour, full into scaled
+	void Scale()
+	{
+		for (int y = 0; y < settings.height; ++y)
+		{
+			uint8_t const *from = full.data() + static_cast<size_t>(y * HEIGHT / settings.height) * WIDTH * 4;
+			uint8_t *to = scaled.data() + static_cast<size_t>(y) * settings.width * 4;
+			for (int x = 0; x < settings.width; ++x)
+			{
+				std::memcpy(to + 4 * x, from + 4 * (x * WIDTH / settings.width), 4);
+			}
+		}
+	}
+
+	Settings const &settings;
+	TileRenderer renderer;
+	MatchCanvas canvas;
+	std::vector<uint8_t> full, scaled, yuv;
+};
+
+int main(int argc, char *argv[])
+{
+	Settings settings;
+	int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	int jobs = cores;
+	std::string packPath = std::string("assets/") + PACK_NAME;
+	std::vector<std::string> replays;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		bool value = i + 1 < argc;
+		if (flag == "--out" && value)
+		{
+			settings.out = argv[++i];
+		}
+		else if (flag == "--size" && value && std::sscanf(argv[i + 1], "%dx%d", &settings.width, &settings.height) == 2)
+		{
+			++i;
+		}
+		else if (flag == "--speed" && value)
+		{
+			settings.speed = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (flag == "--fps" && value)
+		{
+			settings.fps = std::atoi(argv[++i]);
+		}
+		else if (flag == "--highlights" && value)
+		{
+			settings.highlights = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (flag == "--jobs" && value)
+		{
+			jobs = std::atoi(argv[++i]);
+		}
+		else if (flag == "--pack" && value)
+		{
+			packPath = argv[++i];
+		}
+		else if (flag.compare(0, 2, "--") != 0)
+		{
+			replays.push_back(flag);
+		}
+		else
+		{
+			replays.clear();
+			break;
+		}
+	}
+	if (replays.empty() || settings.width < 2 || settings.height < 2 || settings.speed <= 0.0f || settings.fps < 1 || jobs < 1)
+	{
+		std::printf("Usage: render [--out DIR] [--size WxH] [--speed X] [--fps N] [--highlights SECONDS]\n"
+					"              [--jobs N] [--pack FILE] REPLAY...\n");
+		return 1;
+	}
+
+	// Stand-in art is fine when there is no pack
+	AssetPack pack;
+	if (!pack.Open(packPath).empty())
+	{
+		std::printf("No asset pack at %s, drawing stand-ins\n", packPath.c_str());
+	}
+
+	// A replay per thread; spare cores go to the tiles of each frame
+	jobs = std::min(jobs, static_cast<int>(replays.size()));
+	int tileThreads = std::max(1, cores / jobs);
+	std::atomic<int> next{0};
+	std::atomic<long long> frames{0};
+	std::atomic<int> failed{0};
+	auto start = std::chrono::steady_clock::now();
+	WorkerPool pool(jobs);
+	pool.Run([&](int)
+	{
+		ReplayJob job(settings, pack, tileThreads);
+		for (int n = next++; n < static_cast<int>(replays.size()); n = next++)
+		{
+			auto began = std::chrono::steady_clock::now();
+			long long written = job.Run(replays[n]);
+			if (written < 0)
+			{
+				++failed;
+				continue;
+			}
+			float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - began).count();
+			std::printf("%s: %lld frames in %.2f s (%.0f fps)\n", replays[n].c_str(), written, seconds, written / seconds);
+			frames += written;
+		}
+	});
+
+	float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%zu replays, %lld frames in %.2f s (%.0f fps) on %d x %d threads\n", replays.size(), frames.load(), seconds,
+				frames.load() / seconds, jobs, tileThreads);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,427 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "game.h"
+#include "net.h"
+#include "snapshot.h"
+
+// Input replays with keyframes. A replay is the two players' InputBits for
+// every tick, which Match::Tick turns back into the match. Every
+// `interval` ticks the full state is stored as an exact snapshot, and the
+// footer indexes them, so any tick is reached by loading the keyframe
+// before it and simulating at most interval - 1 ticks.
+//
+//   header   "TBRP" version:16 physics:8 interval:32 rules(4 x 32) team size:8
+//   chunk    keyframe size:8 snapshot, then 2 input bytes per tick
+//   ...
+//   index    per keyframe: tick:32 offset:32
+//   footer   ticks:32 keyframes:32 index offset:32 "TBRI"
+//
+// Replays are only valid for the physics they were recorded with, float
+// or fixed point, which the header records.
+
+const uint32_t REPLAY_MAGIC = 0x50524254;       // "TBRP"
+const uint32_t REPLAY_INDEX_MAGIC = 0x49524254; // "TBRI"
+const uint16_t REPLAY_VERSION = 2;
+const int REPLAY_HEADER_SIZE = 4 + 2 + 1 + 4 + 16 + 1;
+const int REPLAY_FOOTER_SIZE = 16;
+const int KEYFRAME_INTERVAL = 256; // about two seconds
+
+#ifdef FIXED_POINT_PHYSICS
+const uint8_t REPLAY_PHYSICS = 1;
+#else
+const uint8_t REPLAY_PHYSICS = 0;
+#endif
+
+class ReplayWriter
+{
+public:
+	ReplayWriter() = default;
+
+	~ReplayWriter()
+	{
+		Close();
+	}
+
+	ReplayWriter(ReplayWriter const &) = delete;
+	ReplayWriter &operator=(ReplayWriter const &) = delete;
+
+	bool Open(std::string const &path, Rules const &rules, int interval = KEYFRAME_INTERVAL)
+	{
+		Close();
+		file = std::fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+
+		this->interval = interval < 1 ? 1 : interval;
+		codec = SnapshotCodec(Precision::Exact, rules);
+		tick = 0;
+		offset = 0;
+		index.clear();
+
+		uint8_t header[REPLAY_HEADER_SIZE];
+		Put32(header, REPLAY_MAGIC);
+		Put16(header + 4, REPLAY_VERSION);
+		header[6] = REPLAY_PHYSICS;
+		Put32(header + 7, static_cast<uint32_t>(this->interval));
+		Put32(header + 11, ScalarBits(rules.ballSpeed));
+		Put32(header + 15, ScalarBits(rules.paddleSpeed));
+		Put32(header + 19, ScalarBits(rules.paddleHeight));
+		uint32_t matchTime;
+		std::memcpy(&matchTime, &rules.matchTime, sizeof(matchTime));
+		Put32(header + 23, matchTime);
+		header[27] = static_cast<uint8_t>(TeamSizeOf(rules));
+		Write(header, sizeof(header));
+
+		return true;
+	}
+
+	bool IsOpen() const { return file != nullptr; }
+
+	// Call before every Match::Tick with the match as it is and the inputs
+	// about to be applied
+	void Record(Match const &before, uint8_t inputOne, uint8_t inputTwo)
+	{
+		if (!file)
+		{
+			return;
+		}
+
+		if (tick % interval == 0)
+		{
+			index.push_back({tick, offset});
+
+			uint8_t keyframe[1 + MAX_SNAPSHOT_BYTES];
+			int size = codec.Encode(codec.Capture(before, tick), nullptr, keyframe + 1, MAX_SNAPSHOT_BYTES);
+			keyframe[0] = static_cast<uint8_t>(size);
+			Write(keyframe, 1 + size);
+		}
+
+		uint8_t inputs[2] = {inputOne, inputTwo};
+		Write(inputs, sizeof(inputs));
+		++tick;
+	}
+
+	// Writes the index; a replay without one cannot be opened
+	void Close()
+	{
+		if (!file)
+		{
+			return;
+		}
+
+		uint32_t indexOffset = offset;
+		for (Entry const &entry : index)
+		{
+			uint8_t bytes[8];
+			Put32(bytes, entry.tick);
+			Put32(bytes + 4, entry.offset);
+			Write(bytes, sizeof(bytes));
+		}
+
+		uint8_t footer[REPLAY_FOOTER_SIZE];
+		Put32(footer, tick);
+		Put32(footer + 4, static_cast<uint32_t>(index.size()));
+		Put32(footer + 8, indexOffset);
+		Put32(footer + 12, REPLAY_INDEX_MAGIC);
+		Write(footer, sizeof(footer));
+
+		std::fclose(file);
+		file = nullptr;
+	}
+
+private:
+	struct Entry
+	{
+		uint32_t tick;
+		uint32_t offset;
+	};
+
+	void Write(uint8_t const *data, size_t size)
+	{
+		std::fwrite(data, 1, size, file);
+		offset += static_cast<uint32_t>(size);
+	}
+
+	std::FILE *file = nullptr;
+	SnapshotCodec codec{Precision::Exact};
+	int interval = KEYFRAME_INTERVAL;
+	uint32_t tick = 0;
+	uint32_t offset = 0;
+	std::vector<Entry> index;
+};
+
+// A whole replay in memory, ready to seek
+class ReplayReader
+{
+public:
+	// Empty string on success, otherwise what is wrong with the file
+	std::string Open(std::string const &path)
+	{
+		data.clear();
+		keyframes.clear();
+
+		std::FILE *file = std::fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			return "cannot open " + path;
+		}
+		uint8_t buffer[1 << 16];
+		size_t got;
+		while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+		{
+			data.insert(data.end(), buffer, buffer + got);
+		}
+		std::fclose(file);
+
+		if (data.size() < REPLAY_HEADER_SIZE + REPLAY_FOOTER_SIZE || Get32(data.data()) != REPLAY_MAGIC)
+		{
+			return "not a replay";
+		}
+		if (Get16(&data[4]) != REPLAY_VERSION)
+		{
+			return "unsupported replay version";
+		}
+		if (data[6] != REPLAY_PHYSICS)
+		{
+			return data[6] ? "recorded with fixed point physics" : "recorded with float physics";
+		}
+
+		interval = static_cast<int>(Get32(&data[7]));
+		if (interval < 1)
+		{
+			return "replay header is damaged";
+		}
+		rules.ballSpeed = BitsScalar(Get32(&data[11]));
+		rules.paddleSpeed = BitsScalar(Get32(&data[15]));
+		rules.paddleHeight = BitsScalar(Get32(&data[19]));
+		uint32_t matchTime = Get32(&data[23]);
+		std::memcpy(&rules.matchTime, &matchTime, sizeof(matchTime));
+		rules.teamSize = data[27];
+		codec = SnapshotCodec(Precision::Exact, rules);
+
+		uint8_t const *footer = &data[data.size() - REPLAY_FOOTER_SIZE];
+		if (Get32(footer + 12) != REPLAY_INDEX_MAGIC)
+		{
+			return "replay has no index (recording did not finish)";
+		}
+		ticks = static_cast<int>(Get32(footer));
+		uint32_t count = Get32(footer + 4);
+		uint32_t indexOffset = Get32(footer + 8);
+		if (ticks < 0 || indexOffset + static_cast<uint64_t>(count) * 8 + REPLAY_FOOTER_SIZE > data.size() ||
+			count != static_cast<uint32_t>((ticks + interval - 1) / interval))
+		{
+			return "replay index is damaged";
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			keyframes.push_back(Get32(&data[indexOffset + i * 8 + 4]));
+		}
+
+		// Each chunk's keyframe and inputs must end before the next chunk
+		// starts, so Step never reads outside its own chunk
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint64_t offset = keyframes[i];
+			uint64_t end = i + 1 < count ? keyframes[i + 1] : indexOffset;
+			uint64_t left = static_cast<uint64_t>(ticks) - static_cast<uint64_t>(i) * interval;
+			uint64_t chunkTicks = left < static_cast<uint64_t>(interval) ? left : interval;
+			if (offset >= end || end > indexOffset || offset + 1 + data[offset] + 2 * chunkTicks > end)
+			{
+				keyframes.clear();
+				return "replay index is damaged";
+			}
+		}
+
+		return "";
+	}
+
+	int TickCount() const { return ticks; }
+	int Interval() const { return interval; }
+	Rules const &GetRules() const { return rules; }
+
+	// The match as it was before the given tick ran, tick in [0, TickCount()]
+	Match Seek(int tick) const
+	{
+		tick = tick < 0 ? 0 : tick > ticks ? ticks : tick;
+		int chunk = tick / interval;
+		if (chunk >= static_cast<int>(keyframes.size()))
+		{
+			chunk = static_cast<int>(keyframes.size()) - 1; // the very end
+		}
+
+		Match match(rules);
+		if (chunk < 0)
+		{
+			return match;
+		}
+
+		codec.Apply(Keyframe(chunk), match);
+
+		for (int at = chunk * interval; at < tick; ++at)
+		{
+			Step(match, at);
+		}
+		return match;
+	}
+
+	// Run one recorded tick on match, which must be the state before it
+	MatchEvent Step(Match &match, int tick) const
+	{
+		uint8_t const *inputs = Inputs(tick);
+		return match.Tick(inputs[0], inputs[1]);
+	}
+
+	// The ticks that scored, in order. The keyframes carry the score, so
+	// only the chunks where it changed (and the last, which has no keyframe
+	// after it) are simulated, never the whole match.
+	std::vector<int> GoalTicks() const
+	{
+		std::vector<int> goals;
+		int chunks = static_cast<int>(keyframes.size());
+		Snapshot from = Keyframe(0);
+		for (int chunk = 0; chunk < chunks; ++chunk)
+		{
+			bool last = chunk + 1 == chunks;
+			Snapshot to = last ? from : Keyframe(chunk + 1);
+			if (last || to.values[FieldScoreOne] != from.values[FieldScoreOne] || to.values[FieldScoreTwo] != from.values[FieldScoreTwo])
+			{
+				Match match = Seek(chunk * interval);
+				int end = last ? ticks : (chunk + 1) * interval;
+				for (int at = chunk * interval; at < end; ++at)
+				{
+					MatchEvent event = Step(match, at);
+					if (event == MatchEvent::GoalOne || event == MatchEvent::GoalTwo)
+					{
+						goals.push_back(at);
+					}
+				}
+			}
+			from = to;
+		}
+		return goals;
+	}
+
+private:
+	Snapshot Keyframe(int chunk) const
+	{
+		Snapshot keyframe;
+		if (chunk < static_cast<int>(keyframes.size()))
+		{
+			SnapshotHistory none;
+			codec.Decode(&data[keyframes[chunk] + 1], data[keyframes[chunk]], none, keyframe);
+		}
+		return keyframe;
+	}
+
+	uint8_t const *Inputs(int tick) const
+	{
+		uint32_t offset = keyframes[tick / interval];
+		return &data[offset + 1 + data[offset] + 2 * (tick % interval)];
+	}
+
+	std::vector<uint8_t> data;
+	std::vector<uint32_t> keyframes; // offset of each chunk
+	Rules rules;
+	SnapshotCodec codec{Precision::Exact};
+	int interval = KEYFRAME_INTERVAL;
+	int ticks = 0;
+};
+
+// Plays a replay back at normal speed, ten times faster, or as fast as the
+// CPU allows within a time budget per frame
+class ReplayPlayer
+{
+public:
+	enum class Speed
+	{
+		Normal,
+		Fast,
+		Max
+	};
+
+	explicit ReplayPlayer(ReplayReader const &reader)
+		: reader(reader), match(reader.Seek(0))
+	{
+	}
+
+	void SeekTo(int target)
+	{
+		tick = target < 0 ? 0 : target > reader.TickCount() ? reader.TickCount() : target;
+		match = reader.Seek(tick);
+		accumulator = 0.0f;
+	}
+
+	// Move on by one frame of wall clock time
+	void Advance(float dtMs, float maxBudgetMs = 12.0f)
+	{
+		Advance(dtMs, [](MatchEvent, Transform const &) {}, maxBudgetMs);
+	}
+
+	// The same, calling onTick(event, ball) after every tick with what the
+	// ball did and where it was before the tick
+	template <typename OnTick>
+	void Advance(float dtMs, OnTick onTick, float maxBudgetMs = 12.0f)
+	{
+		if (paused)
+		{
+			return;
+		}
+
+		if (speed == Speed::Max)
+		{
+			auto start = std::chrono::steady_clock::now();
+			auto budget = std::chrono::duration<float, std::milli>(maxBudgetMs);
+			while (tick < reader.TickCount())
+			{
+				Step(onTick);
+				if ((tick & 63) == 0 && std::chrono::steady_clock::now() - start >= budget)
+				{
+					break;
+				}
+			}
+			return;
+		}
+
+		// Never more than a frame's worth behind, whatever the stall was
+		accumulator += (speed == Speed::Fast ? 10.0f : 1.0f) * (dtMs < 100.0f ? dtMs : 100.0f);
+		while (accumulator >= TICK_MS && tick < reader.TickCount())
+		{
+			Step(onTick);
+			accumulator -= TICK_MS;
+		}
+		if (tick >= reader.TickCount())
+		{
+			accumulator = 0.0f;
+		}
+	}
+
+	Match const &State() const { return match; }
+	int CurrentTick() const { return tick; }
+	float Progress() const { return reader.TickCount() ? static_cast<float>(tick) / reader.TickCount() : 0.0f; }
+
+	bool paused = false;
+	Speed speed = Speed::Normal;
+
+private:
+	template <typename OnTick>
+	void Step(OnTick &onTick)
+	{
+		Transform ball = match.balls.Get<Transform>(0);
+		onTick(reader.Step(match, tick++), ball);
+	}
+
+	ReplayReader const &reader;
+	Match match;
+	int tick = 0;
+	float accumulator = 0.0f;
+};
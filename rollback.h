@@ -0,0 +1,273 @@
+#pragma once
+
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+
+#include "game.h"
+#include "net.h"
+
+// Two player online play with GGPO style rollback. Each side simulates ahead
+// using a guess for the other player's input (the last input it saw, held).
+// When the real input arrives and differs, the match is restored from the
+// snapshot taken at that tick and simulated forward again. A snapshot is a
+// plain copy of Match, so going back and replaying a dozen ticks costs a few
+// microseconds.
+
+static_assert(std::is_trivially_copyable<Match>::value, "snapshots are plain copies");
+
+const int ROLLBACK_WINDOW = 64; // ticks of snapshots and inputs kept
+const int MAX_PREDICTION = 16;  // ticks we may run ahead of the other player's last input
+const int SYNC_INTERVAL = 32;   // ticks between desync checks
+
+class RollbackSession
+{
+public:
+	struct Stats
+	{
+		uint64_t rollbacks = 0;
+		uint64_t resimulatedTicks = 0;
+		int maxRollback = 0;
+		double maxResimMs = 0.0;
+		uint64_t stalls = 0;
+		uint64_t syncChecks = 0;
+		uint64_t desyncs = 0;
+	};
+
+	// An invalid peer means we are hosting; the first packet to arrive tells
+	// us where the other player is. Local input is applied inputDelay ticks
+	// after it is given, which hides that much latency without any rollback.
+	RollbackSession(Team localTeam, NetLink &link, Endpoint peer, int inputDelay = 2)
+		: localTeam(localTeam), link(link), peer(peer), inputDelay(inputDelay)
+	{
+	}
+
+	// Simulate the next tick with this player's input. Returns false without
+	// advancing while the other player is too far behind; try again next frame.
+	bool AdvanceTick(uint8_t localInput)
+	{
+		Poll();
+
+		if (rollbackFrom < tick)
+		{
+			Rollback();
+		}
+		CheckSync();
+
+		if (tick - remoteCount >= MAX_PREDICTION)
+		{
+			++stats.stalls;
+			SendInputs();
+			return false;
+		}
+
+		localInputs[(tick + inputDelay) % ROLLBACK_WINDOW] = localInput;
+		Simulate(tick);
+		++tick;
+
+		SendInputs();
+		return true;
+	}
+
+	Match const &State() const { return match; }
+	int CurrentTick() const { return tick; }
+	bool Connected() const { return remoteCount > 0; }
+
+	// Every input before this tick is known, so states up to it are final
+	int ConfirmedTick() const
+	{
+		return remoteCount < tick ? remoteCount : tick;
+	}
+
+	// Only meaningful for the last ROLLBACK_WINDOW ticks
+	uint32_t ChecksumAt(int at) const
+	{
+		return at == tick ? match.Checksum() : frames[at % ROLLBACK_WINDOW].Checksum();
+	}
+
+	Stats stats;
+
+private:
+	static const uint32_t MAGIC = 0x31524254; // "TBR1"
+	static const int HEADER_SIZE = 21;
+
+	// What the other player is assumed to do at a tick we have no input for.
+	// Held keys carry on, presses are not repeated.
+	uint8_t PredictRemote() const
+	{
+		if (remoteCount == 0)
+		{
+			return 0;
+		}
+		return remoteInputs[(remoteCount - 1) % ROLLBACK_WINDOW] & (InputUp | InputDown);
+	}
+
+	void Simulate(int at)
+	{
+		int slot = at % ROLLBACK_WINDOW;
+		frames[slot] = match;
+
+		uint8_t local = localInputs[slot];
+		uint8_t remote = at < remoteCount ? remoteInputs[slot] : PredictRemote();
+		usedRemote[slot] = remote;
+
+		if (localTeam == Team::One)
+		{
+			match.Tick(local, remote);
+		}
+		else
+		{
+			match.Tick(remote, local);
+		}
+	}
+
+	void Rollback()
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		int depth = tick - rollbackFrom;
+		match = frames[rollbackFrom % ROLLBACK_WINDOW];
+		for (int at = rollbackFrom; at < tick; ++at)
+		{
+			Simulate(at);
+		}
+		rollbackFrom = INT_MAX;
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		++stats.rollbacks;
+		stats.resimulatedTicks += depth;
+		stats.maxRollback = depth > stats.maxRollback ? depth : stats.maxRollback;
+		stats.maxResimMs = ms > stats.maxResimMs ? ms : stats.maxResimMs;
+	}
+
+	void Poll()
+	{
+		uint8_t packet[HEADER_SIZE + ROLLBACK_WINDOW];
+		Endpoint from;
+		int size;
+
+		while ((size = link.Receive(packet, sizeof(packet), from)) >= 0)
+		{
+			if (size < HEADER_SIZE || Get32(packet) != MAGIC)
+			{
+				continue;
+			}
+			if (!peer.valid)
+			{
+				peer = from;
+			}
+			else if (!(from == peer))
+			{
+				continue;
+			}
+
+			int first = static_cast<int>(Get32(packet + 4));
+			int ack = static_cast<int>(Get32(packet + 8));
+			int count = packet[20];
+			if (size < HEADER_SIZE + count)
+			{
+				continue;
+			}
+
+			peerAck = ack > peerAck ? ack : peerAck;
+
+			// Inputs are taken strictly in order; a gap is filled by a resend
+			for (int i = 0; i < count; ++i)
+			{
+				int at = first + i;
+				if (at != remoteCount)
+				{
+					continue;
+				}
+
+				uint8_t input = packet[HEADER_SIZE + i];
+				remoteInputs[at % ROLLBACK_WINDOW] = input;
+				if (at < tick && usedRemote[at % ROLLBACK_WINDOW] != input && at < rollbackFrom)
+				{
+					rollbackFrom = at;
+				}
+				++remoteCount;
+			}
+
+			int syncTick = static_cast<int>(Get32(packet + 12));
+			if (syncTick > remoteSyncTick)
+			{
+				remoteSyncTick = syncTick;
+				remoteSyncChecksum = Get32(packet + 16);
+			}
+		}
+	}
+
+	// Compare the other side's checksum once our state for that tick is final
+	void CheckSync()
+	{
+		if (remoteSyncTick <= checkedSyncTick || remoteSyncTick > ConfirmedTick() ||
+			remoteSyncTick <= tick - ROLLBACK_WINDOW)
+		{
+			return;
+		}
+
+		++stats.syncChecks;
+		if (ChecksumAt(remoteSyncTick) != remoteSyncChecksum)
+		{
+			++stats.desyncs;
+		}
+		checkedSyncTick = remoteSyncTick;
+	}
+
+	// Every packet repeats all inputs the other side has not acknowledged,
+	// so a lost packet costs nothing but a little prediction.
+	void SendInputs()
+	{
+		if (!peer.valid)
+		{
+			return;
+		}
+
+		int end = tick + inputDelay;
+		int begin = peerAck > end - ROLLBACK_WINDOW + 1 ? peerAck : end - ROLLBACK_WINDOW + 1;
+		begin = begin < 0 ? 0 : begin;
+
+		int confirmed = ConfirmedTick();
+		int syncTick = confirmed - confirmed % SYNC_INTERVAL;
+		if (syncTick <= tick - ROLLBACK_WINDOW)
+		{
+			syncTick = 0;
+		}
+
+		uint8_t packet[HEADER_SIZE + ROLLBACK_WINDOW];
+		Put32(packet, MAGIC);
+		Put32(packet + 4, static_cast<uint32_t>(begin));
+		Put32(packet + 8, static_cast<uint32_t>(remoteCount));
+		Put32(packet + 12, static_cast<uint32_t>(syncTick));
+		Put32(packet + 16, ChecksumAt(syncTick));
+		packet[20] = static_cast<uint8_t>(end - begin);
+		for (int at = begin; at < end; ++at)
+		{
+			packet[HEADER_SIZE + at - begin] = localInputs[at % ROLLBACK_WINDOW];
+		}
+
+		link.Send(peer, packet, HEADER_SIZE + end - begin);
+	}
+
+	Team localTeam;
+	NetLink &link;
+	Endpoint peer;
+	int inputDelay;
+
+	Match match;
+	Match frames[ROLLBACK_WINDOW]; // state at the start of each tick
+	uint8_t localInputs[ROLLBACK_WINDOW] = {};
+	uint8_t remoteInputs[ROLLBACK_WINDOW] = {};
+	uint8_t usedRemote[ROLLBACK_WINDOW] = {};
+
+	int tick = 0;        // next tick to simulate
+	int remoteCount = 0; // other player's inputs known for ticks [0, remoteCount)
+	int peerAck = 0;     // other player has our inputs for ticks [0, peerAck)
+	int rollbackFrom = INT_MAX;
+
+	int remoteSyncTick = 0;
+	uint32_t remoteSyncChecksum = 0;
+	int checkedSyncTick = 0;
+};
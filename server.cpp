@@ -0,0 +1,625 @@
+// Headless authoritative match server for Linux. One thread runs an epoll
+// loop over the UDP socket and a tick timer; on every tick a pool of workers
+// advances all running matches with Match::Tick and sends each player the
+// state of their match. Players are paired in the order they join.
+//
+//   server --port 7778 --threads 4 --max-matches 8192 --send-every 2
+//
+// See loadgen.cpp for a client that fills it with bots.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "game.h"
+#include "histogram.h"
+#include "net.h"
+#include "pool.h"
+#include "protocol.h"
+
+const int BATCH = 64;                 // datagrams per recvmmsg/sendmmsg
+const int MAX_CATCH_UP = 4;           // ticks run back to back after a stall
+const double SEAT_TIMEOUT_MS = 5000.0; // silence before a player is dropped
+const int LINGER_TICKS = 125;         // final score stays up for a second
+
+static double NowMs()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static double CpuSeconds()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		   (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static uint64_t AddressKey(sockaddr_in const &address)
+{
+	return (static_cast<uint64_t>(address.sin_addr.s_addr) << 16) | address.sin_port;
+}
+
+struct Seat
+{
+	sockaddr_in address{};
+	uint8_t held = 0;    // up/down as last reported
+	uint8_t pressed = 0; // switch and paddle select since the last tick
+	uint32_t ack = 0;    // newest state tick the player has, 0 for none
+	double lastHeard = 0.0;
+	bool taken = false;
+};
+
+struct Room
+{
+	Match match;
+	Seat seats[2];
+	SnapshotHistory sent;
+	uint32_t tick = 0; // keeps counting while the final score lingers
+	int linger = LINGER_TICKS;
+	bool open = false;
+
+	bool Playing() const { return open && seats[0].taken && seats[1].taken; }
+};
+
+// Per worker send batch and counters, kept on separate cache lines
+struct alignas(64) Outbox
+{
+	uint8_t packets[BATCH][MAX_STATE_SIZE];
+	int sizes[BATCH];
+	sockaddr_in addresses[BATCH];
+	iovec vectors[BATCH];
+	mmsghdr messages[BATCH];
+	int queued = 0;
+	uint64_t bytes = 0;
+	uint64_t failed = 0;
+	uint64_t finished = 0;
+};
+
+class Server
+{
+public:
+	Server(int maxMatches, int threads, int sendEvery)
+		: rooms(maxMatches), pool(threads), outboxes(threads), sendEvery(sendEvery)
+	{
+		for (int i = maxMatches - 1; i >= 0; --i)
+		{
+			freeRooms.push_back(i);
+		}
+	}
+
+	bool Listen(uint16_t port)
+	{
+		if (!socket.Bind(port))
+		{
+			return false;
+		}
+
+		// A tick sends two datagrams per match in one burst
+		int buffer = 8 << 20;
+		setsockopt(socket.Handle(), SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+		setsockopt(socket.Handle(), SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+		timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+		epoll = epoll_create1(0);
+		if (timer < 0 || epoll < 0)
+		{
+			return false;
+		}
+
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = socket.Handle();
+		epoll_ctl(epoll, EPOLL_CTL_ADD, socket.Handle(), &event);
+		event.data.fd = timer;
+		epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &event);
+
+		return true;
+	}
+
+	// Runs until duration seconds have passed, or forever when it is 0
+	void Run(double duration, double reportEvery)
+	{
+		long tickNs = static_cast<long>(TICK_MS * 1000000.0f);
+		itimerspec spec{};
+		spec.it_value.tv_nsec = tickNs;
+		spec.it_interval.tv_nsec = tickNs;
+		timerfd_settime(timer, 0, &spec, nullptr);
+
+		double start = NowMs();
+		double nextReport = start + reportEvery * 1000.0;
+		reportStart = start;
+		reportCpu = CpuSeconds();
+		uint64_t ticksDue = 0;
+
+		epoll_event events[2];
+		while (duration <= 0.0 || NowMs() - start < duration * 1000.0)
+		{
+			int ready = epoll_wait(epoll, events, 2, 1000);
+			for (int e = 0; e < ready; ++e)
+			{
+				if (events[e].data.fd == timer)
+				{
+					uint64_t expirations = 0;
+					if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+					{
+						continue;
+					}
+
+					// How late this tick starts against a perfect 8 ms grid
+					ticksDue += expirations;
+					double ideal = start + ticksDue * static_cast<double>(TICK_MS);
+					lateness.Add((NowMs() - ideal) * 1000.0);
+
+					int run = expirations > MAX_CATCH_UP ? MAX_CATCH_UP : static_cast<int>(expirations);
+					skippedTicks += expirations - run;
+					for (int i = 0; i < run; ++i)
+					{
+						TickAll();
+					}
+				}
+				else
+				{
+					ReceiveAll();
+				}
+			}
+
+			double now = NowMs();
+			if (now >= nextReport)
+			{
+				Report(now);
+				nextReport = now + reportEvery * 1000.0;
+			}
+		}
+
+		Report(NowMs());
+	}
+
+private:
+	void ReceiveAll()
+	{
+		uint8_t packets[BATCH][32];
+		sockaddr_in addresses[BATCH];
+		iovec vectors[BATCH];
+		mmsghdr messages[BATCH];
+
+		for (;;)
+		{
+			for (int i = 0; i < BATCH; ++i)
+			{
+				vectors[i] = {packets[i], sizeof(packets[i])};
+				messages[i] = {};
+				messages[i].msg_hdr.msg_name = &addresses[i];
+				messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+				messages[i].msg_hdr.msg_iov = &vectors[i];
+				messages[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			int received = recvmmsg(socket.Handle(), messages, BATCH, MSG_DONTWAIT, nullptr);
+			if (received <= 0)
+			{
+				return;
+			}
+
+			double now = NowMs();
+			for (int i = 0; i < received; ++i)
+			{
+				int size = static_cast<int>(messages[i].msg_len);
+				bytesIn += size;
+				uint8_t type = ReadHeader(packets[i], size);
+
+				if (type == static_cast<uint8_t>(PacketType::Input) && size >= INPUT_SIZE)
+				{
+					HandleInput(addresses[i], packets[i][PACKET_HEADER_SIZE], Get32(packets[i] + PACKET_HEADER_SIZE + 1), now);
+				}
+				else if (type == static_cast<uint8_t>(PacketType::Join))
+				{
+					HandleJoin(addresses[i], now);
+				}
+			}
+
+			if (received < BATCH)
+			{
+				return;
+			}
+		}
+	}
+
+	void HandleInput(sockaddr_in const &from, uint8_t bits, uint32_t ack, double now)
+	{
+		auto found = seated.find(AddressKey(from));
+		if (found == seated.end())
+		{
+			return;
+		}
+
+		Seat &seat = rooms[found->second / 2].seats[found->second % 2];
+		seat.held = bits & (InputUp | InputDown);
+		seat.pressed |= bits & InputSwitch;
+		// The newest paddle select wins until the tick uses it
+		if (bits >> INPUT_SELECT_SHIFT)
+		{
+			seat.pressed = static_cast<uint8_t>((seat.pressed & InputSwitch) | (bits >> INPUT_SELECT_SHIFT << INPUT_SELECT_SHIFT));
+		}
+		seat.ack = ack > seat.ack ? ack : seat.ack;
+		seat.lastHeard = now;
+	}
+
+	void HandleJoin(sockaddr_in const &from, double now)
+	{
+		uint64_t key = AddressKey(from);
+		auto found = seated.find(key);
+		if (found != seated.end())
+		{
+			Room &room = rooms[found->second / 2];
+			if (!room.match.finished)
+			{
+				// Our welcome got lost
+				room.seats[found->second % 2].lastHeard = now;
+				SendWelcome(from, found->second % 2);
+				return;
+			}
+
+			// Wants another match after this one ended
+			Leave(found->second);
+		}
+
+		int team = 1;
+		if (waitingRoom < 0)
+		{
+			if (freeRooms.empty())
+			{
+				return; // full, the client will ask again
+			}
+			waitingRoom = freeRooms.back();
+			freeRooms.pop_back();
+
+			Room &room = rooms[waitingRoom];
+			room = Room();
+			room.open = true;
+			openRooms++;
+			highWater = waitingRoom + 1 > highWater ? waitingRoom + 1 : highWater;
+			team = 0;
+		}
+
+		Room &room = rooms[waitingRoom];
+		Seat &seat = room.seats[team];
+		seat = Seat();
+		seat.address = from;
+		seat.lastHeard = now;
+		seat.taken = true;
+		seated[key] = waitingRoom * 2 + team;
+		SendWelcome(from, team);
+
+		if (team == 1)
+		{
+			waitingRoom = -1;
+		}
+	}
+
+	void SendWelcome(sockaddr_in const &to, int team)
+	{
+		uint8_t packet[WELCOME_SIZE];
+		PutHeader(packet, PacketType::Welcome);
+		packet[PACKET_HEADER_SIZE] = static_cast<uint8_t>(team);
+		sendto(socket.Handle(), packet, sizeof(packet), 0, reinterpret_cast<sockaddr const *>(&to), sizeof(to));
+		bytesOut += sizeof(packet);
+	}
+
+	// A player leaving ends the match for both
+	void Leave(int seatId)
+	{
+		int index = seatId / 2;
+		Room &room = rooms[index];
+		for (Seat &seat : room.seats)
+		{
+			if (seat.taken)
+			{
+				seated.erase(AddressKey(seat.address));
+				seat.taken = false;
+			}
+		}
+
+		room.open = false;
+		openRooms--;
+		freeRooms.push_back(index);
+		if (waitingRoom == index)
+		{
+			waitingRoom = -1;
+		}
+	}
+
+	void TickAll()
+	{
+		double started = NowMs();
+		int rangeCount = pool.Size();
+		int end = highWater;
+
+		pool.Run([&](int t)
+				 {
+					 int begin = end * t / rangeCount;
+					 TickRange(begin, end * (t + 1) / rangeCount, outboxes[t]);
+				 });
+
+		workTime.Add((NowMs() - started) * 1000.0);
+		++ticks;
+
+		// Closing rooms touches the seat map, so it stays on this thread
+		if (ticks % LINGER_TICKS == 0)
+		{
+			Sweep(started);
+		}
+	}
+
+	void TickRange(int begin, int end, Outbox &outbox)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			Room &room = rooms[i];
+			if (!room.Playing())
+			{
+				continue;
+			}
+
+			bool send = false;
+			if (!room.match.finished)
+			{
+				room.match.Tick(room.seats[0].held | room.seats[0].pressed,
+								room.seats[1].held | room.seats[1].pressed);
+				room.seats[0].pressed = 0;
+				room.seats[1].pressed = 0;
+				outbox.finished += room.match.finished;
+				send = room.match.finished;
+			}
+			else if (room.linger > 0)
+			{
+				--room.linger;
+			}
+			else
+			{
+				continue;
+			}
+
+			++room.tick;
+			if (send || room.tick % sendEvery == 0)
+			{
+				Snapshot snapshot = codec.Capture(room.match, room.tick);
+				room.sent.Add(snapshot);
+				Queue(outbox, room, snapshot, 0);
+				Queue(outbox, room, snapshot, 1);
+			}
+		}
+
+		Flush(outbox);
+	}
+
+	// Each player gets the state as a delta against the last one they have
+	void Queue(Outbox &outbox, Room const &room, Snapshot const &snapshot, int team)
+	{
+		if (outbox.queued == BATCH)
+		{
+			Flush(outbox);
+		}
+
+		Seat const &seat = room.seats[team];
+		Snapshot const *baseline = seat.ack ? room.sent.Find(seat.ack) : nullptr;
+
+		int i = outbox.queued++;
+		uint8_t *packet = outbox.packets[i];
+		PutHeader(packet, PacketType::State);
+		outbox.sizes[i] = PACKET_HEADER_SIZE +
+						  codec.Encode(snapshot, baseline, packet + PACKET_HEADER_SIZE, MAX_SNAPSHOT_BYTES);
+		outbox.addresses[i] = seat.address;
+		outbox.vectors[i] = {packet, static_cast<size_t>(outbox.sizes[i])};
+		outbox.messages[i] = {};
+		outbox.messages[i].msg_hdr.msg_name = &outbox.addresses[i];
+		outbox.messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+		outbox.messages[i].msg_hdr.msg_iov = &outbox.vectors[i];
+		outbox.messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	void Flush(Outbox &outbox)
+	{
+		int done = 0;
+		while (done < outbox.queued)
+		{
+			int sent = sendmmsg(socket.Handle(), outbox.messages + done, outbox.queued - done, 0);
+			if (sent <= 0)
+			{
+				// Socket buffer full; these players miss one update
+				outbox.failed += outbox.queued - done;
+				break;
+			}
+			for (int i = done; i < done + sent; ++i)
+			{
+				outbox.bytes += outbox.sizes[i];
+			}
+			done += sent;
+		}
+		outbox.queued = 0;
+	}
+
+	// Drop silent players and close rooms whose final score has been shown
+	void Sweep(double now)
+	{
+		for (int i = 0; i < highWater; ++i)
+		{
+			Room &room = rooms[i];
+			if (!room.open)
+			{
+				continue;
+			}
+
+			for (int team = 0; team < 2; ++team)
+			{
+				Seat const &seat = room.seats[team];
+				if (seat.taken && now - seat.lastHeard > SEAT_TIMEOUT_MS)
+				{
+					++timedOut;
+					Leave(i * 2 + team);
+					break;
+				}
+			}
+
+			if (room.open && room.match.finished && room.linger <= 0)
+			{
+				Leave(i * 2);
+			}
+		}
+
+		while (highWater > 0 && !rooms[highWater - 1].open)
+		{
+			--highWater;
+		}
+	}
+
+	void Report(double now)
+	{
+		double seconds = (now - reportStart) / 1000.0;
+		double cpu = CpuSeconds();
+		double cores = seconds > 0.0 ? (cpu - reportCpu) / seconds : 0.0;
+
+		int playing = 0;
+		for (int i = 0; i < highWater; ++i)
+		{
+			playing += rooms[i].Playing() && !rooms[i].match.finished;
+		}
+
+		uint64_t out = bytesOut;
+		uint64_t failed = 0;
+		for (Outbox &outbox : outboxes)
+		{
+			out += outbox.bytes;
+			failed += outbox.failed;
+			finished += outbox.finished;
+			outbox.finished = 0;
+			outbox.bytes = 0;
+			outbox.failed = 0;
+		}
+
+		double perMatch = playing > 0 && seconds > 0.0 ? 1.0 / (playing * seconds) : 0.0;
+		std::printf("%d playing, %d rooms, %d players | tick late p50 %.0f us p99 %.0f us max %.0f us, "
+					"work avg %.0f us p99 %.0f us, %llu skipped | cpu %.2f cores, %.0f matches/core | "
+					"per match %.0f B/s out %.0f B/s in, %llu sends failed | %llu finished, %llu timed out\n",
+					playing, openRooms, static_cast<int>(seated.size()),
+					lateness.Percentile(0.5), lateness.Percentile(0.99), lateness.Max(),
+					workTime.Mean(), workTime.Percentile(0.99),
+					static_cast<unsigned long long>(skippedTicks),
+					cores, cores > 0.0 ? playing / cores : 0.0,
+					out * perMatch, bytesIn * perMatch,
+					static_cast<unsigned long long>(failed),
+					static_cast<unsigned long long>(finished), static_cast<unsigned long long>(timedOut));
+		std::fflush(stdout);
+
+		lateness.Clear();
+		workTime.Clear();
+		skippedTicks = 0;
+		bytesIn = 0;
+		bytesOut = 0;
+		reportStart = now;
+		reportCpu = cpu;
+	}
+
+	UdpSocket socket;
+	int timer = -1;
+	int epoll = -1;
+
+	std::vector<Room> rooms;
+	std::vector<int> freeRooms;
+	std::unordered_map<uint64_t, int> seated; // address -> room * 2 + team
+	int waitingRoom = -1;
+	int highWater = 0; // no open room at or past this index
+	int openRooms = 0;
+
+	SnapshotCodec codec;
+	WorkerPool pool;
+	std::vector<Outbox> outboxes;
+	int sendEvery;
+
+	uint64_t ticks = 0;
+	uint64_t skippedTicks = 0;
+	uint64_t bytesIn = 0;
+	uint64_t bytesOut = 0;
+	uint64_t finished = 0;
+	uint64_t timedOut = 0;
+	Histogram lateness;
+	Histogram workTime;
+	double reportStart = 0.0;
+	double reportCpu = 0.0;
+};
+
+int main(int argc, char *argv[])
+{
+	int port = SERVER_PORT;
+	int threads = static_cast<int>(std::thread::hardware_concurrency());
+	int maxMatches = 8192;
+	int sendEvery = 2;
+	double duration = 0.0;
+	double report = 5.0;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string flag = argv[i];
+		double value = std::atof(argv[i + 1]);
+		if (flag == "--port")
+		{
+			port = static_cast<int>(value);
+		}
+		else if (flag == "--threads")
+		{
+			threads = static_cast<int>(value);
+		}
+		else if (flag == "--max-matches")
+		{
+			maxMatches = static_cast<int>(value);
+		}
+		else if (flag == "--send-every")
+		{
+			sendEvery = static_cast<int>(value);
+		}
+		else if (flag == "--duration")
+		{
+			duration = value;
+		}
+		else if (flag == "--report")
+		{
+			report = value;
+		}
+		else
+		{
+			std::printf("Usage: server [--port N] [--threads N] [--max-matches N] [--send-every TICKS] "
+						"[--duration S] [--report S]\n");
+			return 1;
+		}
+	}
+
+	threads = threads < 1 ? 1 : threads;
+	sendEvery = sendEvery < 1 ? 1 : sendEvery > MAX_SNAPSHOT_INTERVAL ? MAX_SNAPSHOT_INTERVAL : sendEvery;
+
+	Server server(maxMatches, threads, sendEvery);
+	if (!server.Listen(static_cast<uint16_t>(port)))
+	{
+		std::printf("could not listen on port %d: %s\n", port, std::strerror(errno));
+		return 1;
+	}
+
+	std::printf("serving up to %d matches on port %d with %d threads, state every %d ticks\n",
+				maxMatches, port, threads, sendEvery);
+	std::fflush(stdout);
+	server.Run(duration, report);
+
+	return EXIT_SUCCESS;
+}
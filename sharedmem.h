@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+enum class SharedAccess
+{
+	Create,   // make it (or take over a stale one), read and write
+	ReadOnly,
+	ReadWrite
+};
+
+// A named block of memory shared between processes: created by the game,
+// opened by readers. The creator removes the name again when it closes.
+class SharedRegion
+{
+public:
+	SharedRegion() = default;
+
+	~SharedRegion()
+	{
+		Close();
+	}
+
+	SharedRegion(SharedRegion const &) = delete;
+	SharedRegion &operator=(SharedRegion const &) = delete;
+
+	bool Open(std::string const &name, size_t size, SharedAccess access)
+	{
+		Close();
+		this->name = name;
+		this->size = size;
+		bool create = access == SharedAccess::Create;
+		bool write = access != SharedAccess::ReadOnly;
+		owner = create;
+
+#ifdef _WIN32
+		std::string mappingName = "Local\\" + name.substr(name[0] == '/' ? 1 : 0);
+		if (create)
+		{
+			mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+										 static_cast<DWORD>(size), mappingName.c_str());
+		}
+		else
+		{
+			mapping = OpenFileMappingA(write ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, mappingName.c_str());
+		}
+		if (!mapping)
+		{
+			return false;
+		}
+		memory = MapViewOfFile(mapping, write ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+#else
+		int fd = shm_open(name.c_str(), create ? O_CREAT | O_RDWR : write ? O_RDWR : O_RDONLY, 0644);
+		if (fd < 0)
+		{
+			return false;
+		}
+		if (create && ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			close(fd);
+			return false;
+		}
+		memory = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+		{
+			memory = nullptr;
+		}
+#endif
+		return memory != nullptr;
+	}
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (memory)
+		{
+			UnmapViewOfFile(memory);
+		}
+		if (mapping)
+		{
+			CloseHandle(mapping);
+		}
+		mapping = nullptr;
+#else
+		if (memory)
+		{
+			munmap(memory, size);
+			if (owner)
+			{
+				shm_unlink(name.c_str());
+			}
+		}
+#endif
+		memory = nullptr;
+	}
+
+	void *Memory() const { return memory; }
+
+private:
+	std::string name;
+	size_t size = 0;
+	bool owner = false;
+	void *memory = nullptr;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#endif
+};
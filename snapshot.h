@@ -0,0 +1,563 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "game.h"
+
+// Compact binary snapshots of a whole match for the server, spectators and
+// replays. A snapshot is the match turned into a row of integer fields. It
+// goes out either in full or as a delta against an older snapshot the
+// receiver is known to have (its baseline). The ball and paddles are
+// predicted from the baseline's velocities, so a typical delta is just a
+// few bits saying nothing unexpected happened.
+
+// Bits packed from the least significant end of each byte
+class BitWriter
+{
+public:
+	BitWriter(uint8_t *out, int capacity)
+		: out(out), capacity(capacity)
+	{
+	}
+
+	// bits is 1..32
+	void Write(uint32_t value, int bits)
+	{
+		pending |= (value & ((1ULL << bits) - 1)) << used;
+		used += bits;
+		while (used >= 8)
+		{
+			Store();
+		}
+	}
+
+	// Flushes the last partial byte. Bytes written, or -1 if out was too small.
+	int Finish()
+	{
+		if (used > 0)
+		{
+			Store();
+		}
+		return size <= capacity ? size : -1;
+	}
+
+private:
+	void Store()
+	{
+		if (size < capacity)
+		{
+			out[size] = static_cast<uint8_t>(pending);
+		}
+		++size;
+		pending >>= 8;
+		used = used > 8 ? used - 8 : 0;
+	}
+
+	uint8_t *out;
+	int capacity;
+	int size = 0;
+	uint64_t pending = 0;
+	int used = 0;
+};
+
+class BitReader
+{
+public:
+	BitReader(uint8_t const *in, int size)
+		: in(in), size(size)
+	{
+	}
+
+	uint32_t Read(int bits)
+	{
+		while (used < bits)
+		{
+			if (position >= size)
+			{
+				overrun = true;
+			}
+			pending |= static_cast<uint64_t>(position < size ? in[position] : 0) << used;
+			++position;
+			used += 8;
+		}
+
+		uint32_t value = static_cast<uint32_t>(pending & ((1ULL << bits) - 1));
+		pending >>= bits;
+		used -= bits;
+		return value;
+	}
+
+	// True once a read went past the end of the data
+	bool Overrun() const { return overrun; }
+
+private:
+	uint8_t const *in;
+	int size;
+	int position = 0;
+	uint64_t pending = 0;
+	int used = 0;
+	bool overrun = false;
+};
+
+// The raw bits of a Scalar, float or fixed point
+inline uint32_t ScalarBits(Scalar value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+inline Scalar BitsScalar(uint32_t bits)
+{
+	Scalar value;
+	std::memcpy(static_cast<void *>(&value), &bits, sizeof(bits));
+	return value;
+}
+
+// Positions are quantized to 1/8 pixel and velocities to 1/4096 pixel per
+// ms. Plenty for drawing and for a bot to aim with.
+const float POSITION_SCALE = 8.0f;
+const int VELOCITY_SHIFT = 12;
+const float VELOCITY_SCALE = 1 << VELOCITY_SHIFT;
+
+// Quantized is what goes over the network. Exact keeps every Scalar's bits,
+// for replay keyframes that the simulation has to resume from.
+enum class Precision
+{
+	Quantized,
+	Exact
+};
+
+enum SnapshotField
+{
+	FieldBallX = 0,
+	FieldBallY,
+	FieldBallVX,
+	FieldBallVY,
+	FieldPaddleY,                               // MAX_PADDLES of them
+	FieldPaddleVY = FieldPaddleY + MAX_PADDLES, // MAX_PADDLES of them
+	FieldFlags = FieldPaddleVY + MAX_PADDLES,
+	FieldScoreOne,
+	FieldScoreTwo,
+	FieldTime,
+	FieldCount
+};
+
+// FieldFlags holds each team's selected paddle, counted within the team,
+// Blue's in the low bits, and whether the match is over
+const int SNAPSHOT_SELECT_BITS = 4;
+const int SNAPSHOT_SELECT_MASK = (1 << SNAPSHOT_SELECT_BITS) - 1;
+
+enum SnapshotFlags : uint16_t
+{
+	SnapshotFinished = 1 << (2 * SNAPSHOT_SELECT_BITS)
+};
+
+static_assert(MAX_TEAM_SIZE <= SNAPSHOT_SELECT_MASK + 1, "selected paddle must fit its flag bits");
+
+struct Snapshot
+{
+	uint32_t tick = 0;
+	int32_t values[FieldCount] = {};
+};
+
+// Fields past the match's team size stay zero and are never sent.
+// Largest Encode output for either precision, worst case delta included
+const int MAX_SNAPSHOT_BYTES = 8 + 5 * FieldCount;
+
+// The last few snapshots one side has sent or received, to delta against.
+// Deltas name their baseline by the low byte of its tick, so the history
+// must span fewer than 256 ticks.
+class SnapshotHistory
+{
+public:
+	static const int SIZE = 32;
+
+	void Add(Snapshot const &snapshot)
+	{
+		entries[next] = snapshot;
+		used[next] = true;
+		next = (next + 1) % SIZE;
+	}
+
+	Snapshot const *Find(uint32_t tick) const
+	{
+		for (int i = 0; i < SIZE; ++i)
+		{
+			if (used[i] && entries[i].tick == tick)
+			{
+				return &entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	// The newest entry whose tick ends in low. A baseline is never more than
+	// 255 ticks old, so older entries with the same low byte are stale.
+	Snapshot const *FindLowByte(uint8_t low) const
+	{
+		for (int back = 1; back <= SIZE; ++back)
+		{
+			int i = (next - back + SIZE) % SIZE;
+			if (used[i] && static_cast<uint8_t>(entries[i].tick) == low)
+			{
+				return &entries[i];
+			}
+		}
+		return nullptr;
+	}
+
+	void Clear()
+	{
+		for (bool &slot : used)
+		{
+			slot = false;
+		}
+	}
+
+private:
+	Snapshot entries[SIZE];
+	bool used[SIZE] = {};
+	int next = 0;
+};
+
+// Longest gap between sent snapshots that keeps a sender's full history
+// within 255 ticks, so it never deltas against a baseline the low byte
+// cannot tell apart from a newer one
+const int MAX_SNAPSHOT_INTERVAL = 255 / SnapshotHistory::SIZE;
+
+class SnapshotCodec
+{
+public:
+	SnapshotCodec(Precision precision = Precision::Quantized, Rules rules = Rules())
+		: precision(precision),
+		  paddleLimit(Quantize(HEIGHT - rules.paddleHeight, POSITION_SCALE)),
+		  paddleCount(2 * TeamSizeOf(rules))
+	{
+		for (int field = 0; field < FieldCount; ++field)
+		{
+			if (Live(field))
+			{
+				live[liveCount++] = static_cast<uint8_t>(field);
+			}
+		}
+	}
+
+	Snapshot Capture(Match const &match, uint32_t tick) const
+	{
+		Snapshot snapshot;
+		snapshot.tick = tick;
+		int32_t *v = snapshot.values;
+
+		Transform const &ball = match.balls.Get<Transform>(0);
+		Velocity const &ballVelocity = match.balls.Get<Velocity>(0);
+		v[FieldBallX] = ToPosition(ball.x);
+		v[FieldBallY] = ToPosition(ball.y);
+		v[FieldBallVX] = ToVelocity(ballVelocity.x);
+		v[FieldBallVY] = ToVelocity(ballVelocity.y);
+
+		Transform const *paddleAt = match.paddles.Get<Transform>();
+		Velocity const *paddleVelocity = match.paddles.Get<Velocity>();
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			v[FieldPaddleY + slot] = ToPosition(paddleAt[slot].y);
+			v[FieldPaddleVY + slot] = ToVelocity(paddleVelocity[slot].y);
+		}
+
+		v[FieldFlags] = (match.currentOne - match.FirstPaddle(Team::One)) |
+						((match.currentTwo - match.FirstPaddle(Team::Two)) << SNAPSHOT_SELECT_BITS) |
+						(match.finished ? SnapshotFinished : 0);
+		v[FieldScoreOne] = match.playerOneScore;
+		v[FieldScoreTwo] = match.playerTwoScore;
+
+		if (precision == Precision::Exact)
+		{
+			std::memcpy(&v[FieldTime], &match.totalTime, sizeof(float));
+		}
+		else
+		{
+			v[FieldTime] = static_cast<int32_t>(std::lround(match.totalTime));
+		}
+
+		return snapshot;
+	}
+
+	// Overwrites everything a snapshot holds; paddle x and the rules stay
+	void Apply(Snapshot const &snapshot, Match &match) const
+	{
+		int32_t const *v = snapshot.values;
+
+		Transform &ball = match.balls.Get<Transform>(0);
+		Velocity &ballVelocity = match.balls.Get<Velocity>(0);
+		ball.x = FromPosition(v[FieldBallX]);
+		ball.y = FromPosition(v[FieldBallY]);
+		ballVelocity.x = FromVelocity(v[FieldBallVX]);
+		ballVelocity.y = FromVelocity(v[FieldBallVY]);
+
+		Transform *paddleAt = match.paddles.Get<Transform>();
+		Velocity *paddleVelocity = match.paddles.Get<Velocity>();
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			paddleAt[slot].y = FromPosition(v[FieldPaddleY + slot]);
+			paddleVelocity[slot].y = FromVelocity(v[FieldPaddleVY + slot]);
+		}
+
+		match.Select(Team::One, v[FieldFlags] & SNAPSHOT_SELECT_MASK);
+		match.Select(Team::Two, (v[FieldFlags] >> SNAPSHOT_SELECT_BITS) & SNAPSHOT_SELECT_MASK);
+		match.finished = (v[FieldFlags] & SnapshotFinished) != 0;
+		match.playerOneScore = v[FieldScoreOne];
+		match.playerTwoScore = v[FieldScoreTwo];
+
+		if (precision == Precision::Exact)
+		{
+			std::memcpy(&match.totalTime, &v[FieldTime], sizeof(float));
+		}
+		else
+		{
+			match.totalTime = static_cast<float>(v[FieldTime]);
+		}
+	}
+
+	// Full snapshot when baseline is null. Bytes written, or -1 if capacity
+	// is too small (MAX_SNAPSHOT_BYTES always fits).
+	//
+	//   full   0 tick:32 field:width...
+	//   delta  1 baseline:8 age:code [0 | 1 (0 | 1 residual:code)...]
+	//
+	// Only the fields of the match's paddles are written.
+	int Encode(Snapshot const &current, Snapshot const *baseline, uint8_t *out, int capacity) const
+	{
+		BitWriter writer(out, capacity);
+
+		if (!baseline || current.tick <= baseline->tick || current.tick - baseline->tick > 255)
+		{
+			writer.Write(0, 1);
+			writer.Write(current.tick, 32);
+			for (int i = 0; i < liveCount; ++i)
+			{
+				writer.Write(static_cast<uint32_t>(current.values[live[i]]), Width(live[i]));
+			}
+			return writer.Finish();
+		}
+
+		uint32_t age = current.tick - baseline->tick;
+		writer.Write(1, 1);
+		writer.Write(baseline->tick & 0xFF, 8);
+		WriteCode(writer, age);
+
+		int32_t predicted[FieldCount];
+		Predict(*baseline, age, predicted);
+
+		bool changed = std::memcmp(current.values, predicted, sizeof(predicted)) != 0;
+		writer.Write(changed, 1);
+		if (changed)
+		{
+			for (int i = 0; i < liveCount; ++i)
+			{
+				int field = live[i];
+				bool differs = current.values[field] != predicted[field];
+				writer.Write(differs, 1);
+				if (differs)
+				{
+					WriteCode(writer, ZigZag(current.values[field] - predicted[field]));
+				}
+			}
+		}
+
+		return writer.Finish();
+	}
+
+	// False if the data is cut short or its baseline is not in history
+	bool Decode(uint8_t const *in, int size, SnapshotHistory const &history, Snapshot &out) const
+	{
+		BitReader reader(in, size);
+
+		if (reader.Read(1) == 0)
+		{
+			out.tick = reader.Read(32);
+			std::memset(out.values, 0, sizeof(out.values));
+			for (int i = 0; i < liveCount; ++i)
+			{
+				int field = live[i];
+				uint32_t value = reader.Read(Width(field));
+				out.values[field] = field < FieldFlags ? SignExtend(value, Width(field)) : static_cast<int32_t>(value);
+			}
+			return !reader.Overrun();
+		}
+
+		Snapshot const *baseline = history.FindLowByte(static_cast<uint8_t>(reader.Read(8)));
+		uint32_t age = ReadCode(reader);
+		if (!baseline || reader.Overrun())
+		{
+			return false;
+		}
+
+		out.tick = baseline->tick + age;
+		Predict(*baseline, age, out.values);
+
+		if (reader.Read(1))
+		{
+			for (int i = 0; i < liveCount; ++i)
+			{
+				if (reader.Read(1))
+				{
+					out.values[live[i]] += UnZigZag(ReadCode(reader));
+				}
+			}
+		}
+
+		return !reader.Overrun();
+	}
+
+private:
+	static int32_t Quantize(Scalar value, float scale)
+	{
+		return static_cast<int32_t>(std::lround(static_cast<float>(value) * scale));
+	}
+
+	int32_t ToPosition(Scalar value) const
+	{
+		return precision == Precision::Exact ? static_cast<int32_t>(ScalarBits(value)) : Quantize(value, POSITION_SCALE);
+	}
+
+	int32_t ToVelocity(Scalar value) const
+	{
+		return precision == Precision::Exact ? static_cast<int32_t>(ScalarBits(value)) : Quantize(value, VELOCITY_SCALE);
+	}
+
+	Scalar FromPosition(int32_t v) const
+	{
+		return precision == Precision::Exact ? BitsScalar(static_cast<uint32_t>(v)) : Scalar(v / POSITION_SCALE);
+	}
+
+	Scalar FromVelocity(int32_t v) const
+	{
+		return precision == Precision::Exact ? BitsScalar(static_cast<uint32_t>(v)) : Scalar(v / VELOCITY_SCALE);
+	}
+
+	// Whether a field belongs to one of the match's paddles or is not a
+	// paddle field at all
+	bool Live(int field) const
+	{
+		if (field >= FieldPaddleY && field < FieldPaddleVY)
+		{
+			return field - FieldPaddleY < paddleCount;
+		}
+		if (field >= FieldPaddleVY && field < FieldFlags)
+		{
+			return field - FieldPaddleVY < paddleCount;
+		}
+		return true;
+	}
+
+	// Bits a field takes in a full snapshot
+	int Width(int field) const
+	{
+		if (field == FieldFlags)
+		{
+			return 2 * SNAPSHOT_SELECT_BITS + 1;
+		}
+		if (field == FieldScoreOne || field == FieldScoreTwo)
+		{
+			return 16;
+		}
+		if (field == FieldTime)
+		{
+			return precision == Precision::Exact ? 32 : 24;
+		}
+		return precision == Precision::Exact ? 32 : 16;
+	}
+
+	static int32_t SignExtend(uint32_t value, int width)
+	{
+		if (width == 32)
+		{
+			return static_cast<int32_t>(value);
+		}
+		uint32_t sign = 1u << (width - 1);
+		return static_cast<int32_t>((value ^ sign) - sign);
+	}
+
+	// Where the baseline says things should be age ticks later. Quantized
+	// only: exact fields are raw bits, which do not extrapolate. A finished
+	// match stands still.
+	void Predict(Snapshot const &baseline, uint32_t age, int32_t *predicted) const
+	{
+		std::memcpy(predicted, baseline.values, sizeof(baseline.values));
+		if (precision == Precision::Exact || (baseline.values[FieldFlags] & SnapshotFinished))
+		{
+			return;
+		}
+
+		int64_t steps = static_cast<int64_t>(age) * static_cast<int64_t>(TICK_MS * POSITION_SCALE);
+		auto Extrapolate = [&](int32_t position, int32_t velocity)
+		{
+			return position + static_cast<int32_t>((velocity * steps + (1 << (VELOCITY_SHIFT - 1))) >> VELOCITY_SHIFT);
+		};
+
+		predicted[FieldBallX] = Extrapolate(baseline.values[FieldBallX], baseline.values[FieldBallVX]);
+		predicted[FieldBallY] = Extrapolate(baseline.values[FieldBallY], baseline.values[FieldBallVY]);
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			int32_t y = Extrapolate(baseline.values[FieldPaddleY + slot], baseline.values[FieldPaddleVY + slot]);
+			predicted[FieldPaddleY + slot] = y < 0 ? 0 : y > paddleLimit ? paddleLimit : y;
+		}
+		predicted[FieldTime] += static_cast<int32_t>(age * TICK_MS);
+	}
+
+	static uint32_t ZigZag(int32_t value)
+	{
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+
+	static int32_t UnZigZag(uint32_t value)
+	{
+		return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+	}
+
+	// 0 + 4 bits, 10 + 8 bits, 110 + 12 bits or 111 + 32 bits
+	static void WriteCode(BitWriter &writer, uint32_t value)
+	{
+		if (value < (1u << 4))
+		{
+			writer.Write(0, 1);
+			writer.Write(value, 4);
+		}
+		else if (value < (1u << 8))
+		{
+			writer.Write(1, 2);
+			writer.Write(value, 8);
+		}
+		else if (value < (1u << 12))
+		{
+			writer.Write(3, 3);
+			writer.Write(value, 12);
+		}
+		else
+		{
+			writer.Write(7, 3);
+			writer.Write(value, 32);
+		}
+	}
+
+	static uint32_t ReadCode(BitReader &reader)
+	{
+		if (reader.Read(1) == 0)
+		{
+			return reader.Read(4);
+		}
+		if (reader.Read(1) == 0)
+		{
+			return reader.Read(8);
+		}
+		return reader.Read(1) == 0 ? reader.Read(12) : reader.Read(32);
+	}
+
+	Precision precision;
+	int32_t paddleLimit;
+	int paddleCount;
+	uint8_t live[FieldCount]; // the fields that are sent, in order
+	int liveCount = 0;
+};
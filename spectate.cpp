@@ -0,0 +1,100 @@
+// Follows a running game through its shared memory spectator feed and
+// prints the score and ball speed as they change.
+//
+//   spectate                 one status line, refreshed ten times a second
+//   spectate --every         a line per tick, with a count of ticks missed
+//   spectate --feed NAME     a game started with --feed NAME
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "game.h"
+#include "snapshot.h"
+#include "spectator.h"
+
+int main(int argc, char *argv[])
+{
+	std::string name = SPECTATOR_FEED;
+	bool every = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (flag == "--every")
+		{
+			every = true;
+		}
+		else if (flag == "--feed" && i + 1 < argc)
+		{
+			name = argv[++i];
+		}
+		else
+		{
+			std::printf("Usage: spectate [--every] [--feed NAME]\n");
+			return 1;
+		}
+	}
+
+	SpectatorReader reader;
+	while (!reader.Open(name))
+	{
+		std::printf("\rwaiting for a game on %s...", name.c_str());
+		std::fflush(stdout);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	std::printf("\n");
+
+	uint64_t next = reader.Written();
+	uint64_t missed = 0;
+	auto lastPrint = std::chrono::steady_clock::now();
+
+	for (;;)
+	{
+		Snapshot snapshot;
+		uint64_t written = reader.Written();
+
+		if (every)
+		{
+			// Fell more than a ring behind: skip to what is still there
+			if (written > next + SPECTATOR_SLOTS / 2)
+			{
+				missed += written - SPECTATOR_SLOTS / 2 - next;
+				next = written - SPECTATOR_SLOTS / 2;
+			}
+			for (; next < written; ++next)
+			{
+				if (!reader.Read(next, snapshot))
+				{
+					++missed;
+					continue;
+				}
+				int32_t const *v = snapshot.values;
+				std::printf("tick %u  %d-%d  ball %.1f,%.1f  %llu missed\n", snapshot.tick,
+							v[FieldScoreOne], v[FieldScoreTwo],
+							v[FieldBallX] / POSITION_SCALE, v[FieldBallY] / POSITION_SCALE,
+							static_cast<unsigned long long>(missed));
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(4));
+			continue;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastPrint >= std::chrono::milliseconds(100) && reader.Latest(snapshot))
+		{
+			int32_t const *v = snapshot.values;
+			float vx = v[FieldBallVX] / VELOCITY_SCALE;
+			float vy = v[FieldBallVY] / VELOCITY_SCALE;
+			float speed = std::sqrt(vx * vx + vy * vy) * 1000.0f; // pixels per second
+
+			std::printf("\rBlue %d - %d Red   %5.1fs   ball %6.1f px/s %s   ", v[FieldScoreOne], v[FieldScoreTwo],
+						v[FieldTime] / 1000.0f, speed, (v[FieldFlags] & SnapshotFinished) ? "(finished)" : "          ");
+			std::fflush(stdout);
+			lastPrint = now;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "game.h"
+#include "sharedmem.h"
+#include "snapshot.h"
+
+// Live match state for other processes (overlays, stat trackers, recorders)
+// through a shared memory ring. The game writes one quantized Snapshot per
+// tick and never waits for anyone; each slot carries a sequence number
+// (a seqlock) so a reader can tell when the game overwrote the slot it was
+// copying, and simply tries again. Any number of readers can follow along.
+
+const char *const SPECTATOR_FEED = "/tinyball-spectate";
+const uint32_t SPECTATOR_MAGIC = 0x46534254; // "TBSF"
+const uint32_t SPECTATOR_VERSION = 2;
+const int SPECTATOR_SLOTS = 256; // two seconds of ticks
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+			  "atomics in shared memory must not hide a lock");
+
+struct SpectatorSlot
+{
+	std::atomic<uint32_t> sequence; // odd while being written
+	std::atomic<uint32_t> tick;
+	std::atomic<int32_t> values[FieldCount];
+};
+
+struct alignas(64) SpectatorRing
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t fieldCount;
+	uint32_t teamSize; // paddle fields past 2 * teamSize stay zero
+	std::atomic<uint64_t> written; // snapshots published so far
+	alignas(64) SpectatorSlot slots[SPECTATOR_SLOTS];
+};
+
+// The game's side: one writer
+class SpectatorFeed
+{
+public:
+	bool Open(std::string const &name = SPECTATOR_FEED, int teamSize = Rules().teamSize)
+	{
+		if (!region.Open(name, sizeof(SpectatorRing), SharedAccess::Create))
+		{
+			ring = nullptr;
+			return false;
+		}
+
+		ring = static_cast<SpectatorRing *>(region.Memory());
+		ring->written.store(0, std::memory_order_relaxed);
+		for (SpectatorSlot &slot : ring->slots)
+		{
+			slot.sequence.store(0, std::memory_order_relaxed);
+		}
+		ring->version = SPECTATOR_VERSION;
+		ring->slotCount = SPECTATOR_SLOTS;
+		ring->fieldCount = FieldCount;
+		ring->teamSize = static_cast<uint32_t>(teamSize);
+		std::atomic_thread_fence(std::memory_order_release);
+		ring->magic = SPECTATOR_MAGIC;
+		return true;
+	}
+
+	bool IsOpen() const { return ring != nullptr; }
+
+	// Wait free; a few dozen stores
+	void Publish(Snapshot const &snapshot)
+	{
+		if (!ring)
+		{
+			return;
+		}
+
+		uint64_t index = ring->written.load(std::memory_order_relaxed);
+		SpectatorSlot &slot = ring->slots[index % SPECTATOR_SLOTS];
+
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot.tick.store(snapshot.tick, std::memory_order_relaxed);
+		for (int field = 0; field < FieldCount; ++field)
+		{
+			slot.values[field].store(snapshot.values[field], std::memory_order_relaxed);
+		}
+
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		ring->written.store(index + 1, std::memory_order_release);
+	}
+
+private:
+	SharedRegion region;
+	SpectatorRing *ring = nullptr;
+};
+
+// A reader's side. Read-only mapping, so a reader can never disturb the game.
+class SpectatorReader
+{
+public:
+	bool Open(std::string const &name = SPECTATOR_FEED)
+	{
+		ring = nullptr;
+		if (!region.Open(name, sizeof(SpectatorRing), SharedAccess::ReadOnly))
+		{
+			return false;
+		}
+
+		SpectatorRing *mapped = static_cast<SpectatorRing *>(region.Memory());
+		if (mapped->magic != SPECTATOR_MAGIC || mapped->version != SPECTATOR_VERSION ||
+			mapped->slotCount != SPECTATOR_SLOTS || mapped->fieldCount != FieldCount)
+		{
+			return false;
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		ring = mapped;
+		return true;
+	}
+
+	int TeamSize() const
+	{
+		return ring ? static_cast<int>(ring->teamSize) : 0;
+	}
+
+	// Snapshots published so far
+	uint64_t Written() const
+	{
+		return ring ? ring->written.load(std::memory_order_acquire) : 0;
+	}
+
+	// Copy out snapshot number index. False if it is not written yet or the
+	// game has already lapped it.
+	bool Read(uint64_t index, Snapshot &out) const
+	{
+		if (!ring)
+		{
+			return false;
+		}
+
+		SpectatorSlot const &slot = ring->slots[index % SPECTATOR_SLOTS];
+		for (;;)
+		{
+			uint64_t written = ring->written.load(std::memory_order_acquire);
+			if (index >= written || written - index > SPECTATOR_SLOTS - 1)
+			{
+				return false;
+			}
+
+			uint32_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				continue; // being written right now
+			}
+
+			out.tick = slot.tick.load(std::memory_order_relaxed);
+			for (int field = 0; field < FieldCount; ++field)
+			{
+				out.values[field] = slot.values[field].load(std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == before)
+			{
+				// The copy is whole, but the game may have lapped the slot
+				// between the check above and the sequence, and then it
+				// holds a newer snapshot than the one asked for
+				return ring->written.load(std::memory_order_acquire) - index <= SPECTATOR_SLOTS - 1;
+			}
+		}
+	}
+
+	// The newest snapshot, if there is one
+	bool Latest(Snapshot &out) const
+	{
+		uint64_t written = Written();
+		return written > 0 && Read(written - 1, out);
+	}
+
+private:
+	SharedRegion region;
+	SpectatorRing const *ring = nullptr;
+};
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "game.h"
+#include "pack.h"
+#include "pool.h"
+
+// Full resolution pictures of a match drawn on the CPU, for capturing video
+// on machines with no GPU. The frame is cut into tiles that the threads of
+// a pool take one at a time; each tile copies its part of the pitch and
+// alpha blends whatever sprites and HUD text cross it, four pixels at a
+// time with SSE2. RenderReference draws the same list one pixel at a time
+// on one thread, and the two agree to the byte. Nothing goes through SDL.
+//
+// Pixels are RGBA bytes (SDL_PIXELFORMAT_RGBA32), rows WIDTH * 4 apart.
+
+const int TILE_WIDTH = 120;
+const int TILE_HEIGHT = 72;
+const int TILES_ACROSS = (WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+const int TILES_DOWN = (HEIGHT + TILE_HEIGHT - 1) / TILE_HEIGHT;
+const int GLYPH_SCALE = 4; // the 5 x 7 font drawn 20 x 28, near the game's 40 point text
+
+struct Bitmap
+{
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels; // RGBA, width * 4 bytes a row
+
+	uint8_t *Row(int y) { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+	uint8_t const *Row(int y) const { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+};
+
+// Nearest neighbour resize of RGBA pixels, e.g. an image out of the pack
+inline Bitmap ScaleBitmap(uint8_t const *rgba, int width, int height, int pitch, int toWidth, int toHeight)
+{
+	Bitmap out;
+	out.width = toWidth;
+	out.height = toHeight;
+	out.pixels.resize(static_cast<size_t>(toWidth) * toHeight * 4);
+	for (int y = 0; y < toHeight; ++y)
+	{
+		uint8_t const *from = rgba + static_cast<size_t>(y * height / toHeight) * pitch;
+		uint8_t *to = out.Row(y);
+		for (int x = 0; x < toWidth; ++x)
+		{
+			std::memcpy(to + 4 * x, from + 4 * (x * width / toWidth), 4);
+		}
+	}
+	return out;
+}
+
+// The characters the HUD uses, five bits a row, top row first
+struct Glyph
+{
+	char c;
+	uint8_t rows[7];
+};
+
+const Glyph FONT[] = {
+	{'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}}, {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+	{'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}}, {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+	{'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}}, {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+	{'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}}, {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+	{'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}}, {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+	{'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}}, {':', {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}},
+	{'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}}, {'-', {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}},
+	{'B', {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}}, {'G', {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}},
+	{'R', {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}}, {'T', {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+	{'a', {0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F}}, {'d', {0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F}},
+	{'e', {0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E}}, {'i', {0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E}},
+	{'l', {0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}}, {'m', {0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11}},
+	{'o', {0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E}}, {'p', {0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10}},
+	{'r', {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}}, {'s', {0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E}},
+	{'u', {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D}}, {'x', {0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11}},
+	{'y', {0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E}},
+};
+
+// White text on a clear background with a soft shadow, so the blend has
+// every alpha to chew on. Characters not in FONT are spaces.
+inline Bitmap TextBitmap(char const *text, int scale = GLYPH_SCALE)
+{
+	int length = static_cast<int>(std::strlen(text));
+	Bitmap out;
+	out.width = length * 6 * scale + scale;
+	out.height = 7 * scale + scale;
+	out.pixels.assign(static_cast<size_t>(out.width) * out.height * 4, 0);
+
+	// Shadow, offset by one font pixel, then the glyphs over it
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		int offset = pass == 0 ? scale : 0;
+		uint8_t shade = pass == 0 ? 0x00 : 0xFF;
+		uint8_t alpha = pass == 0 ? 0x60 : 0xFF;
+		for (int n = 0; n < length; ++n)
+		{
+			Glyph const *glyph = nullptr;
+			for (Glyph const &candidate : FONT)
+			{
+				glyph = candidate.c == text[n] ? &candidate : glyph;
+			}
+			for (int row = 0; glyph && row < 7 * scale; ++row)
+			{
+				for (int column = 0; column < 5 * scale; ++column)
+				{
+					if (glyph->rows[row / scale] & (0x10 >> (column / scale)))
+					{
+						uint8_t *pixel = out.Row(row + offset) + 4 * (n * 6 * scale + column + offset);
+						pixel[0] = pixel[1] = pixel[2] = shade;
+						pixel[3] = alpha;
+					}
+				}
+			}
+		}
+	}
+	return out;
+}
+
+// dst = src over dst, rounded to nearest. src's alpha weighs its colour and
+// gives the new alpha (a + dst alpha * (255 - a) / 255).
+inline void BlendPixel(uint8_t *dst, uint8_t const *src)
+{
+	unsigned a = src[3];
+	for (int c = 0; c < 4; ++c)
+	{
+		unsigned s = c == 3 ? 255 : src[c];
+		unsigned t = s * a + dst[c] * (255 - a) + 128;
+		dst[c] = static_cast<uint8_t>((t + (t >> 8)) >> 8);
+	}
+}
+
+// BlendPixel over a span; the same arithmetic in 16 bit lanes
+inline void BlendSpan(uint8_t *dst, uint8_t const *src, int count)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i opaque = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	__m128i full = _mm_set1_epi16(255);
+	__m128i half = _mm_set1_epi16(128);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + 4 * i));
+		__m128i alphas = _mm_srli_epi32(s, 24);
+		int clear = _mm_movemask_epi8(_mm_cmpeq_epi32(alphas, zero));
+		if (clear == 0xFFFF)
+		{
+			continue;
+		}
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(alphas, _mm_set1_epi32(255))) == 0xFFFF)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), s);
+			continue;
+		}
+
+		__m128i d = _mm_loadu_si128(reinterpret_cast<__m128i const *>(dst + 4 * i));
+		__m128i a = _mm_or_si128(alphas, _mm_slli_epi32(alphas, 8));
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		s = _mm_or_si128(s, opaque);
+
+		auto blend = [&](__m128i s16, __m128i d16, __m128i a16)
+		{
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(s16, a16), _mm_mullo_epi16(d16, _mm_sub_epi16(full, a16)));
+			t = _mm_add_epi16(t, half);
+			return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		};
+		__m128i low = blend(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(a, zero));
+		__m128i high = blend(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(a, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * i), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (dst += 4 * i, src += 4 * i; i < count; ++i, dst += 4, src += 4)
+	{
+		BlendPixel(dst, src);
+	}
+}
+
+class TileRenderer
+{
+public:
+	explicit TileRenderer(int threads = static_cast<int>(std::thread::hardware_concurrency()))
+		: pool(threads < 1 ? 1 : threads)
+	{
+		background.width = WIDTH;
+		background.height = HEIGHT;
+		background.pixels.assign(static_cast<size_t>(WIDTH) * HEIGHT * 4, 0xFF);
+		job = [this](int)
+		{
+			for (int tile = next.fetch_add(1); tile < TILES_ACROSS * TILES_DOWN; tile = next.fetch_add(1))
+			{
+				RenderTile(tile, target);
+			}
+		};
+	}
+
+	TileRenderer(TileRenderer const &) = delete;
+	TileRenderer &operator=(TileRenderer const &) = delete;
+
+	// Copied into every frame first; stretched to the window if need be
+	void SetBackground(Bitmap const &bitmap)
+	{
+		background = bitmap.width == WIDTH && bitmap.height == HEIGHT
+						 ? bitmap
+						 : ScaleBitmap(bitmap.pixels.data(), bitmap.width, bitmap.height, bitmap.width * 4, WIDTH, HEIGHT);
+		for (int y = 0; y < HEIGHT; ++y)
+		{
+			for (int x = 0; x < WIDTH; ++x)
+			{
+				background.Row(y)[4 * x + 3] = 0xFF;
+			}
+		}
+	}
+
+	// Start a new frame's draw list
+	void Clear()
+	{
+		items.clear();
+	}
+
+	// Blended in the order added. The bitmap must live until Render returns.
+	void Add(Bitmap const &bitmap, int x, int y)
+	{
+		items.push_back(Item{&bitmap, x, y});
+	}
+
+	// Writes WIDTH * HEIGHT * 4 bytes
+	void Render(uint8_t *frame)
+	{
+		target = frame;
+		next = 0;
+		pool.Run(job);
+	}
+
+	// The same picture, one pixel at a time on the calling thread
+	void RenderReference(uint8_t *frame) const
+	{
+		std::memcpy(frame, background.pixels.data(), background.pixels.size());
+		for (Item const &item : items)
+		{
+			for (int y = 0; y < item.bitmap->height; ++y)
+			{
+				for (int x = 0; x < item.bitmap->width; ++x)
+				{
+					int atX = item.x + x, atY = item.y + y;
+					if (atX >= 0 && atX < WIDTH && atY >= 0 && atY < HEIGHT)
+					{
+						BlendPixel(frame + (static_cast<size_t>(atY) * WIDTH + atX) * 4, item.bitmap->Row(y) + 4 * x);
+					}
+				}
+			}
+		}
+	}
+
+	int Threads() const { return pool.Size(); }
+
+private:
+	struct Item
+	{
+		Bitmap const *bitmap;
+		int x, y;
+	};
+
+	void RenderTile(int tile, uint8_t *frame) const
+	{
+		int left = tile % TILES_ACROSS * TILE_WIDTH;
+		int top = tile / TILES_ACROSS * TILE_HEIGHT;
+		int right = std::min(left + TILE_WIDTH, WIDTH);
+		int bottom = std::min(top + TILE_HEIGHT, HEIGHT);
+
+		for (int y = top; y < bottom; ++y)
+		{
+			std::memcpy(frame + (static_cast<size_t>(y) * WIDTH + left) * 4, background.Row(y) + left * 4, (right - left) * 4);
+		}
+
+		for (Item const &item : items)
+		{
+			int x0 = std::max(item.x, left), x1 = std::min(item.x + item.bitmap->width, right);
+			int y0 = std::max(item.y, top), y1 = std::min(item.y + item.bitmap->height, bottom);
+			for (int y = y0; y < y1; ++y)
+			{
+				BlendSpan(frame + (static_cast<size_t>(y) * WIDTH + x0) * 4, item.bitmap->Row(y - item.y) + (x0 - item.x) * 4, x1 - x0);
+			}
+		}
+	}
+
+	Bitmap background;
+	std::vector<Item> items;
+	WorkerPool pool;
+	std::function<void(int)> job;
+	std::atomic<int> next{0};
+	uint8_t *target = nullptr;
+};
+
+// What main.cpp draws for a match: the pitch, the ball and paddles, scores
+// and timer, using the images in the asset pack or plain stand-ins for any
+// it lacks.
+class MatchCanvas
+{
+public:
+	explicit MatchCanvas(AssetPack const *pack = nullptr)
+	{
+		pitch = FromPack(pack, "football-pitch.png", WIDTH, HEIGHT);
+		sprites[static_cast<int>(SpriteId::Ball)] = FromPack(pack, "ball.png", BALL_WIDTH, BALL_HEIGHT);
+		sprites[static_cast<int>(SpriteId::Blue)] = FromPack(pack, "blue/image_part_004.png", PADDLE_WIDTH, PADDLE_HEIGHT);
+		sprites[static_cast<int>(SpriteId::Red)] = FromPack(pack, "red/image.png", PADDLE_WIDTH, PADDLE_HEIGHT);
+
+		if (pitch.pixels.empty())
+		{
+			pitch = StandInPitch();
+		}
+		if (sprites[static_cast<int>(SpriteId::Ball)].pixels.empty())
+		{
+			sprites[static_cast<int>(SpriteId::Ball)] = StandInBall();
+		}
+		uint8_t const colors[2][3] = {{0x30, 0x60, 0xFF}, {0xE0, 0x30, 0x30}};
+		for (int team = 0; team < 2; ++team)
+		{
+			Bitmap &paddle = sprites[static_cast<int>(team == 0 ? SpriteId::Blue : SpriteId::Red)];
+			if (paddle.pixels.empty())
+			{
+				paddle = StandInPaddle(colors[team]);
+			}
+		}
+	}
+
+	void SetBackground(TileRenderer &renderer) const
+	{
+		renderer.SetBackground(pitch);
+	}
+
+	// Fills the renderer's draw list for this moment of the match. caption
+	// replaces the timer text when it is not null.
+	void Queue(TileRenderer &renderer, Match const &match, char const *caption = nullptr)
+	{
+		char text[64];
+		std::snprintf(text, sizeof(text), "%d", match.playerOneScore);
+		SetText(0, text);
+		std::snprintf(text, sizeof(text), "%d", match.playerTwoScore);
+		SetText(1, text);
+		int tenths = static_cast<int>(static_cast<float>(match.totalTime) / 100);
+		std::snprintf(text, sizeof(text), "Timer: %d.%ds / 90s", tenths / 10, tenths % 10);
+		SetText(2, caption ? caption : text);
+
+		renderer.Clear();
+		match.Each<Transform, SpriteId>([&](Transform const &position, SpriteId sprite)
+		{
+			renderer.Add(sprites[static_cast<int>(sprite)], static_cast<int>(static_cast<float>(position.x)),
+						 static_cast<int>(static_cast<float>(position.y)));
+		});
+		renderer.Add(texts[0].bitmap, WIDTH / 4, 50);
+		renderer.Add(texts[1].bitmap, 3 * WIDTH / 4, 50);
+		renderer.Add(texts[2].bitmap, WIDTH / 4 + 55, HEIGHT * 8 / 10);
+	}
+
+private:
+	struct Text
+	{
+		std::string shown;
+		Bitmap bitmap;
+	};
+
+	// Text is drawn into its bitmap only when it changes
+	void SetText(int slot, char const *text)
+	{
+		if (texts[slot].shown != text || texts[slot].bitmap.pixels.empty())
+		{
+			texts[slot].shown = text;
+			texts[slot].bitmap = TextBitmap(text);
+		}
+	}
+
+	static Bitmap FromPack(AssetPack const *pack, char const *name, int width, int height)
+	{
+		PackEntry const *entry = pack && pack->IsOpen() ? pack->Find(name) : nullptr;
+		if (!entry || entry->kind != PackKind::Image)
+		{
+			return Bitmap();
+		}
+		return ScaleBitmap(pack->Data(*entry), entry->width, entry->height, entry->pitch, width, height);
+	}
+
+	static Bitmap Blank(int width, int height)
+	{
+		Bitmap out;
+		out.width = width;
+		out.height = height;
+		out.pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+		return out;
+	}
+
+	// Mown stripes, a halfway line and a centre circle
+	static Bitmap StandInPitch()
+	{
+		Bitmap out = Blank(WIDTH, HEIGHT);
+		for (int y = 0; y < HEIGHT; ++y)
+		{
+			for (int x = 0; x < WIDTH; ++x)
+			{
+				float fromCentre = std::hypot(x - WIDTH / 2.0f, y - HEIGHT / 2.0f);
+				bool line = std::abs(x - WIDTH / 2) < 2 || std::fabs(fromCentre - 90.0f) < 2.0f;
+				bool light = x / 90 % 2 == 0;
+				uint8_t *pixel = out.Row(y) + 4 * x;
+				pixel[0] = line ? 0xE0 : light ? 0x35 : 0x2E;
+				pixel[1] = line ? 0xE0 : light ? 0x8A : 0x7D;
+				pixel[2] = line ? 0xE0 : light ? 0x38 : 0x32;
+				pixel[3] = 0xFF;
+			}
+		}
+		return out;
+	}
+
+	// A white disc with an antialiased rim
+	static Bitmap StandInBall()
+	{
+		Bitmap out = Blank(BALL_WIDTH, BALL_HEIGHT);
+		float radius = BALL_WIDTH / 2.0f;
+		for (int y = 0; y < BALL_HEIGHT; ++y)
+		{
+			for (int x = 0; x < BALL_WIDTH; ++x)
+			{
+				float inside = radius - std::hypot(x + 0.5f - radius, y + 0.5f - radius);
+				float coverage = inside >= 1.0f ? 1.0f : inside <= 0.0f ? 0.0f : inside;
+				uint8_t *pixel = out.Row(y) + 4 * x;
+				pixel[0] = pixel[1] = pixel[2] = 0xFF;
+				pixel[3] = static_cast<uint8_t>(255.0f * coverage + 0.5f);
+			}
+		}
+		return out;
+	}
+
+	// A solid block with a half transparent edge
+	static Bitmap StandInPaddle(uint8_t const *color)
+	{
+		Bitmap out = Blank(PADDLE_WIDTH, PADDLE_HEIGHT);
+		for (int y = 0; y < PADDLE_HEIGHT; ++y)
+		{
+			for (int x = 0; x < PADDLE_WIDTH; ++x)
+			{
+				bool edge = x == 0 || y == 0 || x == PADDLE_WIDTH - 1 || y == PADDLE_HEIGHT - 1;
+				uint8_t *pixel = out.Row(y) + 4 * x;
+				std::memcpy(pixel, color, 3);
+				pixel[3] = edge ? 0x80 : 0xFF;
+			}
+		}
+		return out;
+	}
+
+	Bitmap pitch;
+	Bitmap sprites[3]; // by SpriteId
+	Text texts[3];     // scores, then the timer
+};
@@ -0,0 +1,535 @@
+// Self-play tuning harness. Plays headless bot-versus-bot matches for every
+// configuration of a grid (or of an evolutionary search) and writes one CSV
+// row per configuration. Rows already in the output file are reused instead
+// of replayed, so an interrupted sweep picks up where it stopped.
+//
+//   tune --ball-speed 0.4,0.6,0.8 --paddle-height 35,45,60 --matches 2000
+//   tune --evolve 20 --population 16 --dead-zone 0,20 --aim -1,1 --objective winrate
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "game.h"
+#include "ai.h"
+
+enum Param
+{
+	BallSpeed = 0,
+	PaddleSpeed,
+	PaddleHeight,
+	DeadZone,
+	Aim,
+	SwitchMargin,
+	Error,
+	ParamCount
+};
+
+const char *PARAM_NAMES[ParamCount] = {
+	"ball_speed", "paddle_speed", "paddle_height", "dead_zone", "aim", "switch_margin", "error"};
+
+const char *PARAM_FLAGS[ParamCount] = {
+	"--ball-speed", "--paddle-speed", "--paddle-height", "--dead-zone", "--aim", "--switch-margin", "--error"};
+
+struct Config
+{
+	float values[ParamCount];
+};
+
+struct Result
+{
+	int matches = 0;
+	int wins = 0;
+	int draws = 0;
+	long long hits = 0;
+	long long goals = 0;
+	double playedMs = 0.0;
+
+	double WinRate() const { return matches ? (wins + 0.5 * draws) / matches : 0.0; }
+	double RallyHits() const { return matches ? static_cast<double>(hits) / (goals + matches) : 0.0; }
+	double GoalsPerMinute() const { return playedMs > 0.0 ? goals / (playedMs / 60000.0) : 0.0; }
+};
+
+struct Options
+{
+	std::vector<float> grid[ParamCount];
+	float opponentError = 30.0f;
+	int matches = 1000;
+	int threads = 0;
+	int generations = 0;
+	int population = 16;
+	uint64_t seed = 1;
+	float tick = TICK_MS;
+	std::string objective = "winrate";
+	std::string out = "tune.csv";
+};
+
+// Stable across standard libraries, unlike std::hash
+static uint64_t HashKey(std::string const &key)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (char c : key)
+	{
+		h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t SplitMix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// Everything that identifies a configuration's row in the CSV
+static std::string ConfigKey(Config const &config, Options const &options)
+{
+	char buffer[256];
+	int length = 0;
+	for (int i = 0; i < ParamCount; ++i)
+	{
+		length += std::snprintf(buffer + length, sizeof(buffer) - length, "%.4f,", config.values[i]);
+	}
+	std::snprintf(buffer + length, sizeof(buffer) - length, "%.4f,%.2f,%d",
+				  options.opponentError, options.tick, options.matches);
+
+	return buffer;
+}
+
+// One full match, candidate against the reference bot. Odd matches swap
+// sides so neither gets the first kickoff for free.
+static void PlayMatch(Config const &config, Options const &options, uint64_t matchSeed, Result &result)
+{
+	Rules rules;
+	rules.ballSpeed = config.values[BallSpeed];
+	rules.paddleSpeed = config.values[PaddleSpeed];
+	rules.paddleHeight = config.values[PaddleHeight];
+
+	AiParams candidate;
+	candidate.deadZone = config.values[DeadZone];
+	candidate.aim = config.values[Aim];
+	candidate.switchMargin = config.values[SwitchMargin];
+	candidate.error = config.values[Error];
+
+	AiParams reference;
+	reference.error = options.opponentError;
+
+	Match match(rules);
+
+	// Vary the opening so the thousands of matches are not all the same one
+	uint64_t r = SplitMix(matchSeed);
+	float spread = static_cast<float>(r & 0xFFFF) / 65535.0f;
+	float angle = static_cast<float>((r >> 16) & 0xFFFF) / 65535.0f;
+	match.balls.Get<Transform>(0).y = BALL_HEIGHT + spread * (HEIGHT - 3.0f * BALL_HEIGHT);
+	match.balls.Get<Velocity>(0).y = Scalar(angle * 1.5f - 0.75f) * rules.ballSpeed;
+
+	bool candidateIsOne = (matchSeed & 1) == 0;
+	AiParams const &one = candidateIsOne ? candidate : reference;
+	AiParams const &two = candidateIsOne ? reference : candidate;
+
+	bool buttons[4] = {};
+	while (!match.finished)
+	{
+		ApplyAi(match, Team::One, DecideAi(match, Team::One, one), buttons);
+		ApplyAi(match, Team::Two, DecideAi(match, Team::Two, two), buttons);
+		match.ApplyButtons(buttons);
+
+		if (match.Update(options.tick) == MatchEvent::PaddleHit)
+		{
+			++result.hits;
+		}
+	}
+
+	int mine = candidateIsOne ? match.playerOneScore : match.playerTwoScore;
+	int theirs = candidateIsOne ? match.playerTwoScore : match.playerOneScore;
+
+	++result.matches;
+	result.wins += mine > theirs;
+	result.draws += mine == theirs;
+	result.goals += mine + theirs;
+	result.playedMs += match.totalTime;
+}
+
+static Result Evaluate(Config const &config, Options const &options, uint64_t configSeed)
+{
+	int threadCount = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+	threadCount = std::max(1, std::min(threadCount, options.matches));
+
+	std::vector<Result> partial(threadCount);
+	std::vector<std::thread> workers;
+	std::atomic<int> next{0};
+
+	for (int t = 0; t < threadCount; ++t)
+	{
+		workers.emplace_back([&, t]()
+		{
+			for (int i = next++; i < options.matches; i = next++)
+			{
+				PlayMatch(config, options, configSeed * 1000003ULL + i, partial[t]);
+			}
+		});
+	}
+
+	Result total;
+	for (int t = 0; t < threadCount; ++t)
+	{
+		workers[t].join();
+		total.matches += partial[t].matches;
+		total.wins += partial[t].wins;
+		total.draws += partial[t].draws;
+		total.hits += partial[t].hits;
+		total.goals += partial[t].goals;
+		total.playedMs += partial[t].playedMs;
+	}
+
+	return total;
+}
+
+static double Fitness(Result const &result, Options const &options)
+{
+	if (options.objective == "rally")
+	{
+		return result.RallyHits();
+	}
+	if (options.objective.compare(0, 4, "gpm=") == 0)
+	{
+		return -std::fabs(result.GoalsPerMinute() - std::atof(options.objective.c_str() + 4));
+	}
+
+	return result.WinRate();
+}
+
+class Sweep
+{
+public:
+	Sweep(Options const &options)
+		: options(options)
+	{
+		Load();
+
+		file.open(options.out, std::ios::app);
+		if (file.tellp() == 0)
+		{
+			for (int i = 0; i < ParamCount; ++i)
+			{
+				file << PARAM_NAMES[i] << ",";
+			}
+			file << "opponent_error,tick_ms,matches,win_rate,draw_rate,rally_hits,goals_per_min" << std::endl;
+		}
+	}
+
+	Result Run(Config const &config)
+	{
+		std::string key = ConfigKey(config, options);
+		auto cached = done.find(key);
+		if (cached != done.end())
+		{
+			++reused;
+			return cached->second;
+		}
+
+		uint64_t configSeed = SplitMix(options.seed ^ HashKey(key));
+		Result result = Evaluate(config, options, configSeed);
+		done[key] = result;
+
+		char row[160];
+		std::snprintf(row, sizeof(row), "%.4f,%.4f,%.3f,%.3f",
+					  result.WinRate(),
+					  result.matches ? static_cast<double>(result.draws) / result.matches : 0.0,
+					  result.RallyHits(), result.GoalsPerMinute());
+		file << key << "," << row << std::endl; // flushed, this is the checkpoint
+
+		std::cout << key << "  win " << result.WinRate() << "  rally " << result.RallyHits()
+				  << "  gpm " << result.GoalsPerMinute() << std::endl;
+
+		return result;
+	}
+
+	int reused = 0;
+
+private:
+	// Rebuild finished results from an existing CSV. Only the derived rates
+	// are stored, which is all the search needs.
+	void Load()
+	{
+		std::ifstream in(options.out);
+		std::string line;
+		std::getline(in, line); // header
+
+		int const keyColumns = ParamCount + 3;
+		while (std::getline(in, line))
+		{
+			std::vector<std::string> cells;
+			std::stringstream stream(line);
+			std::string cell;
+			while (std::getline(stream, cell, ','))
+			{
+				cells.push_back(cell);
+			}
+			if (static_cast<int>(cells.size()) != keyColumns + 4)
+			{
+				continue; // torn write from an interrupted run
+			}
+
+			std::string key = cells[0];
+			for (int i = 1; i < keyColumns; ++i)
+			{
+				key += "," + cells[i];
+			}
+
+			Result result;
+			result.matches = std::atoi(cells[keyColumns - 1].c_str());
+			double winRate = std::atof(cells[keyColumns].c_str());
+			double drawRate = std::atof(cells[keyColumns + 1].c_str());
+			double rally = std::atof(cells[keyColumns + 2].c_str());
+			double gpm = std::atof(cells[keyColumns + 3].c_str());
+
+			result.draws = static_cast<int>(std::lround(drawRate * result.matches));
+			result.wins = static_cast<int>(std::lround(winRate * result.matches - 0.5 * result.draws));
+			result.playedMs = 60000.0 * result.matches;
+			result.goals = std::llround(gpm * result.matches);
+			result.hits = std::llround(rally * (result.goals + result.matches));
+			done[key] = result;
+		}
+	}
+
+	Options const &options;
+	std::map<std::string, Result> done;
+	std::ofstream file;
+};
+
+static void RunGrid(Options const &options, Sweep &sweep)
+{
+	int total = 1;
+	for (int i = 0; i < ParamCount; ++i)
+	{
+		total *= static_cast<int>(options.grid[i].size());
+	}
+
+	for (int index = 0; index < total; ++index)
+	{
+		Config config;
+		int rest = index;
+		for (int i = ParamCount - 1; i >= 0; --i)
+		{
+			int count = static_cast<int>(options.grid[i].size());
+			config.values[i] = options.grid[i][rest % count];
+			rest /= count;
+		}
+		sweep.Run(config);
+	}
+}
+
+// Truncation selection with Gaussian mutation. Each parameter searches the
+// interval spanned by its grid values; single-valued parameters stay fixed.
+// The generator is seeded, so a resumed search proposes the same candidates
+// and finds them in the CSV.
+static void RunEvolution(Options const &options, Sweep &sweep)
+{
+	std::mt19937_64 rng(options.seed);
+	float low[ParamCount], high[ParamCount];
+	for (int i = 0; i < ParamCount; ++i)
+	{
+		low[i] = *std::min_element(options.grid[i].begin(), options.grid[i].end());
+		high[i] = *std::max_element(options.grid[i].begin(), options.grid[i].end());
+	}
+
+	auto clampToRange = [&](Config &config)
+	{
+		for (int i = 0; i < ParamCount; ++i)
+		{
+			config.values[i] = std::min(high[i], std::max(low[i], config.values[i]));
+			// Same rounding as the CSV so cached rows line up
+			config.values[i] = std::round(config.values[i] * 10000.0f) / 10000.0f;
+		}
+	};
+
+	std::vector<Config> population(options.population);
+	for (Config &config : population)
+	{
+		for (int i = 0; i < ParamCount; ++i)
+		{
+			config.values[i] = std::uniform_real_distribution<float>(low[i], high[i])(rng);
+		}
+		clampToRange(config);
+	}
+
+	int elite = std::max(1, options.population / 4);
+	for (int generation = 0; generation < options.generations; ++generation)
+	{
+		std::vector<std::pair<double, Config>> scored;
+		for (Config const &config : population)
+		{
+			scored.emplace_back(Fitness(sweep.Run(config), options), config);
+		}
+		std::stable_sort(scored.begin(), scored.end(),
+						 [](auto const &a, auto const &b) { return a.first > b.first; });
+
+		std::cout << "generation " << generation << " best " << scored[0].first
+				  << "  " << ConfigKey(scored[0].second, options) << std::endl;
+
+		for (int k = 0; k < options.population; ++k)
+		{
+			population[k] = scored[k % elite].second;
+			if (k < elite)
+			{
+				continue;
+			}
+			for (int i = 0; i < ParamCount; ++i)
+			{
+				if (high[i] > low[i])
+				{
+					float sigma = 0.1f * (high[i] - low[i]);
+					population[k].values[i] += std::normal_distribution<float>(0.0f, sigma)(rng);
+				}
+			}
+			clampToRange(population[k]);
+		}
+	}
+}
+
+static std::vector<float> ParseList(char const *text)
+{
+	std::vector<float> values;
+	std::stringstream stream(text);
+	std::string cell;
+	while (std::getline(stream, cell, ','))
+	{
+		values.push_back(std::strtof(cell.c_str(), nullptr));
+	}
+
+	return values;
+}
+
+static void Usage()
+{
+	std::cout << "Usage: tune [options]\n"
+				 "  --ball-speed, --paddle-speed, --paddle-height,\n"
+				 "  --dead-zone, --aim, --switch-margin, --error LIST\n"
+				 "                        comma separated values for the candidate\n"
+				 "  --opponent-error PX   misjudgement of the reference bot (30)\n"
+				 "  --matches N           matches per configuration (1000)\n"
+				 "  --threads N           worker threads (all cores)\n"
+				 "  --tick MS             simulation step (8)\n"
+				 "  --evolve GENERATIONS  evolutionary search over the value ranges\n"
+				 "  --population N        candidates per generation (16)\n"
+				 "  --objective winrate|rally|gpm=TARGET\n"
+				 "  --seed N              (1)\n"
+				 "  --out FILE            results and checkpoint (tune.csv)\n";
+}
+
+int main(int argc, char *argv[])
+{
+	Options options;
+	Rules rules;
+	AiParams ai;
+	float const defaults[ParamCount] = {
+		static_cast<float>(rules.ballSpeed), static_cast<float>(rules.paddleSpeed),
+		static_cast<float>(rules.paddleHeight), static_cast<float>(ai.deadZone),
+		static_cast<float>(ai.aim), static_cast<float>(ai.switchMargin), 30.0f};
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string flag = argv[i];
+		if (flag == "--help" || flag == "-h" || i + 1 >= argc)
+		{
+			Usage();
+			return flag == "--help" || flag == "-h" ? 0 : 1;
+		}
+
+		char const *value = argv[++i];
+		bool known = false;
+		for (int p = 0; p < ParamCount; ++p)
+		{
+			if (flag == PARAM_FLAGS[p])
+			{
+				options.grid[p] = ParseList(value);
+				known = true;
+			}
+		}
+
+		if (known)
+		{
+			continue;
+		}
+		else if (flag == "--opponent-error")
+		{
+			options.opponentError = std::strtof(value, nullptr);
+		}
+		else if (flag == "--matches")
+		{
+			options.matches = std::max(1, std::atoi(value));
+		}
+		else if (flag == "--threads")
+		{
+			options.threads = std::atoi(value);
+		}
+		else if (flag == "--tick")
+		{
+			options.tick = std::strtof(value, nullptr);
+		}
+		else if (flag == "--evolve")
+		{
+			options.generations = std::atoi(value);
+		}
+		else if (flag == "--population")
+		{
+			options.population = std::max(2, std::atoi(value));
+		}
+		else if (flag == "--objective")
+		{
+			options.objective = value;
+		}
+		else if (flag == "--seed")
+		{
+			options.seed = std::strtoull(value, nullptr, 10);
+		}
+		else if (flag == "--out")
+		{
+			options.out = value;
+		}
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	for (int p = 0; p < ParamCount; ++p)
+	{
+		if (options.grid[p].empty())
+		{
+			options.grid[p].push_back(defaults[p]);
+		}
+	}
+
+	Sweep sweep(options);
+	if (options.generations > 0)
+	{
+		RunEvolution(options, sweep);
+	}
+	else
+	{
+		RunGrid(options, sweep);
+	}
+
+	if (sweep.reused > 0)
+	{
+		std::cout << "reused " << sweep.reused << " configurations from " << options.out << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "game.h"
+#include "ai.h"
+#include "pool.h"
+#include "raster.h"
+
+// Many independent matches advanced together, for reinforcement learning.
+// The agent plays Blue in every match, Red is the built-in bot. State is kept
+// structure-of-arrays; each step loads one match into a Match on the stack,
+// runs the ordinary ApplyButtons/Update on it and stores it back, so the rules
+// are exactly the ones the game plays by. All buffers are allocated up front.
+class VecEnv
+{
+public:
+	enum Action : uint8_t
+	{
+		Stay = 0,
+		Up,
+		Down,
+		Switch
+	};
+
+	VecEnv(int count, int threads = 1, Rules rules = Rules(), AiParams opponent = AiParams(), Scalar tick = TICK_MS)
+		: count(count), rules(rules), opponent(opponent), tick(tick),
+		  ballX(count), ballY(count), ballVX(count), ballVY(count),
+		  paddleCount(2 * TeamSizeOf(rules)), obsSize(4 + paddleCount + 2),
+		  paddleVY(count * paddleCount), paddleY(count * paddleCount),
+		  currentOne(count), currentTwo(count), scoreOne(count), scoreTwo(count),
+		  totalTime(count), observations(count * obsSize), rewards(count), dones(count)
+	{
+		Reset();
+
+		// Split on 16 env boundaries so no two threads write the same cache line
+		int threadCount = threads < 1 ? 1 : threads;
+		int chunk = (count + threadCount - 1) / threadCount;
+		chunk = (chunk + 15) & ~15;
+		for (int begin = 0; begin < count; begin += chunk)
+		{
+			ranges.push_back({begin, begin + chunk < count ? begin + chunk : count});
+		}
+
+		pool.reset(new WorkerPool(static_cast<int>(ranges.size())));
+	}
+
+	VecEnv(VecEnv const &) = delete;
+	VecEnv &operator=(VecEnv const &) = delete;
+
+	void Reset()
+	{
+		Match match(rules);
+		for (int i = 0; i < count; ++i)
+		{
+			Store(i, match);
+			rewards[i] = 0.0f;
+			dones[i] = 0;
+		}
+	}
+
+	// Advance every match by one tick. actions holds Count() entries. A match
+	// that ends is reported done and restarted in the same call, so the
+	// observation returned for it is the opening of the next match.
+	void Step(uint8_t const *actions)
+	{
+		pendingActions = actions;
+		Dispatch(Job::Step);
+	}
+
+	// Draw every match into frames, Count() * raster.FrameBytes() bytes laid
+	// out one frame after another. Uses the same threads as Step.
+	void Render(Rasterizer const &raster, uint8_t *frames)
+	{
+		pendingRaster = &raster;
+		pendingFrames = frames;
+		Dispatch(Job::Render);
+	}
+
+	int Count() const { return count; }
+
+	// Floats per match: ball x, y, vx, vy, every paddle's y, then each team's
+	// selected paddle as 0..1 across the team
+	int ObservationSize() const { return obsSize; }
+	float const *Observations() const { return observations.data(); }
+	float const *Rewards() const { return rewards.data(); }
+	uint8_t const *Dones() const { return dones.data(); }
+
+private:
+	struct Range
+	{
+		int begin;
+		int end;
+	};
+
+	enum class Job
+	{
+		Step,
+		Render
+	};
+
+	// Run a job over all matches, this thread taking the first range
+	void Dispatch(Job next)
+	{
+		job = next;
+		pool->Run([this](int t) { RunRange(t); });
+	}
+
+	void RunRange(int t)
+	{
+		if (job == Job::Step)
+		{
+			StepRange(ranges[t].begin, ranges[t].end);
+		}
+		else
+		{
+			RenderRange(ranges[t].begin, ranges[t].end);
+		}
+	}
+
+	void Load(int i, Match &match) const
+	{
+		match.balls.Get<Transform>(0) = Vec2(ballX[i], ballY[i]);
+		match.balls.Get<Velocity>(0) = Vec2(ballVX[i], ballVY[i]);
+		Transform *paddleAt = match.paddles.Get<Transform>();
+		Velocity *paddleVelocity = match.paddles.Get<Velocity>();
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			paddleAt[slot].y = paddleY[i * paddleCount + slot];
+			paddleVelocity[slot].y = paddleVY[i * paddleCount + slot];
+		}
+		match.currentOne = currentOne[i];
+		match.currentTwo = currentTwo[i];
+		match.playerOneScore = scoreOne[i];
+		match.playerTwoScore = scoreTwo[i];
+		match.totalTime = totalTime[i];
+	}
+
+	void Store(int i, Match const &match)
+	{
+		Transform const &ball = match.balls.Get<Transform>(0);
+		Velocity const &ballVelocity = match.balls.Get<Velocity>(0);
+		Transform const *paddleAt = match.paddles.Get<Transform>();
+		Velocity const *paddleVelocity = match.paddles.Get<Velocity>();
+
+		ballX[i] = ball.x;
+		ballY[i] = ball.y;
+		ballVX[i] = ballVelocity.x;
+		ballVY[i] = ballVelocity.y;
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			paddleY[i * paddleCount + slot] = paddleAt[slot].y;
+			paddleVY[i * paddleCount + slot] = paddleVelocity[slot].y;
+		}
+		currentOne[i] = static_cast<uint8_t>(match.currentOne);
+		currentTwo[i] = static_cast<uint8_t>(match.currentTwo);
+		scoreOne[i] = static_cast<uint16_t>(match.playerOneScore);
+		scoreTwo[i] = static_cast<uint16_t>(match.playerTwoScore);
+		totalTime[i] = match.totalTime;
+
+		float *obs = &observations[i * obsSize];
+		obs[0] = static_cast<float>(ball.x) / WIDTH;
+		obs[1] = static_cast<float>(ball.y) / HEIGHT;
+		obs[2] = static_cast<float>(ballVelocity.x / rules.ballSpeed);
+		obs[3] = static_cast<float>(ballVelocity.y / rules.ballSpeed);
+		for (int slot = 0; slot < paddleCount; ++slot)
+		{
+			obs[4 + slot] = static_cast<float>(paddleAt[slot].y) / HEIGHT;
+		}
+		float spread = paddleCount > 2 ? paddleCount / 2 - 1.0f : 1.0f;
+		obs[4 + paddleCount] = (match.currentOne - match.FirstPaddle(Team::One)) / spread;
+		obs[5 + paddleCount] = (match.currentTwo - match.FirstPaddle(Team::Two)) / spread;
+	}
+
+	void StepRange(int begin, int end)
+	{
+		// Paddle x and the rules never change, so the template carries them
+		Match match(rules);
+
+		for (int i = begin; i < end; ++i)
+		{
+			Load(i, match);
+
+			bool buttons[4] = {};
+			uint8_t action = pendingActions[i];
+			buttons[Buttons::PaddleOneUp] = action == Up;
+			buttons[Buttons::PaddleOneDown] = action == Down;
+			if (action == Switch)
+			{
+				match.Switch(Team::One);
+			}
+			ApplyAi(match, Team::Two, DecideAi(match, Team::Two, opponent), buttons);
+
+			match.ApplyButtons(buttons);
+			MatchEvent event = match.Update(tick);
+
+			rewards[i] = event == MatchEvent::GoalOne ? 1.0f : event == MatchEvent::GoalTwo ? -1.0f : 0.0f;
+			dones[i] = match.finished;
+			if (match.finished)
+			{
+				match.Reset();
+			}
+
+			Store(i, match);
+		}
+	}
+
+	void RenderRange(int begin, int end)
+	{
+		Match match(rules);
+		int frameBytes = pendingRaster->FrameBytes();
+
+		for (int i = begin; i < end; ++i)
+		{
+			Load(i, match);
+			pendingRaster->Draw(match, pendingFrames + static_cast<size_t>(i) * frameBytes);
+		}
+	}
+
+	int count;
+	Rules rules;
+	AiParams opponent;
+	Scalar tick;
+
+	std::vector<Scalar> ballX, ballY, ballVX, ballVY;
+	int paddleCount;
+	int obsSize;
+
+	std::vector<Scalar> paddleVY; // paddleCount per match
+	std::vector<Scalar> paddleY;  // paddleCount per match
+	std::vector<uint8_t> currentOne, currentTwo;
+	std::vector<uint16_t> scoreOne, scoreTwo;
+	std::vector<float> totalTime;
+
+	std::vector<float> observations;
+	std::vector<float> rewards;
+	std::vector<uint8_t> dones;
+
+	std::vector<Range> ranges;
+	std::unique_ptr<WorkerPool> pool;
+	Job job = Job::Step;
+	uint8_t const *pendingActions = nullptr;
+	Rasterizer const *pendingRaster = nullptr;
+	uint8_t *pendingFrames = nullptr;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Tells you about files written in a directory and its subdirectories, on a
+// thread of its own. Editors save in several steps (truncate, write, rename
+// over), so a file is reported once it has been quiet for WATCH_SETTLE_MS,
+// and once per burst of writes. Linux only (inotify); elsewhere Start fails.
+
+const int WATCH_SETTLE_MS = 20;
+
+class DirectoryWatcher
+{
+public:
+	// name is relative to the root, seen is when the last write arrived
+	typedef std::function<void(std::string const &name, std::chrono::steady_clock::time_point seen)> Changed;
+
+	DirectoryWatcher() = default;
+
+	~DirectoryWatcher()
+	{
+		Stop();
+	}
+
+	DirectoryWatcher(DirectoryWatcher const &) = delete;
+	DirectoryWatcher &operator=(DirectoryWatcher const &) = delete;
+
+	bool Start(std::string const &root, Changed changed)
+	{
+		Stop();
+#ifdef __linux__
+		notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (notify < 0 || pipe(wake) != 0)
+		{
+			Stop();
+			return false;
+		}
+
+		this->root = root.empty() || root.back() == '/' ? root : root + "/";
+		if (!Watch(""))
+		{
+			Stop();
+			return false;
+		}
+
+		stopping = false;
+		thread = std::thread([this, changed]() { Run(changed); });
+		return true;
+#else
+		(void)root;
+		(void)changed;
+		return false;
+#endif
+	}
+
+	void Stop()
+	{
+#ifdef __linux__
+		if (thread.joinable())
+		{
+			stopping = true;
+			char byte = 0;
+			(void)!write(wake[1], &byte, 1);
+			thread.join();
+		}
+		int *fds[] = {&notify, &wake[0], &wake[1]};
+		for (int *fd : fds)
+		{
+			if (*fd >= 0)
+			{
+				close(*fd);
+			}
+			*fd = -1;
+		}
+		directories.clear();
+#endif
+	}
+
+	bool Running() const { return thread.joinable(); }
+
+private:
+#ifdef __linux__
+	struct Pending
+	{
+		std::string name;
+		std::chrono::steady_clock::time_point seen;
+	};
+
+	// Adds a watch on root + path and everything below it
+	bool Watch(std::string const &path)
+	{
+		std::string full = root + path;
+		int wd = inotify_add_watch(notify, full.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (wd < 0)
+		{
+			return false;
+		}
+		if (static_cast<int>(directories.size()) <= wd)
+		{
+			directories.resize(wd + 1);
+		}
+		directories[wd] = path;
+
+		DIR *dir = opendir(full.c_str());
+		if (!dir)
+		{
+			return true;
+		}
+		while (dirent *entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			struct stat info;
+			if (name != "." && name != ".." && stat((full + name).c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+			{
+				Watch(path + name + "/");
+			}
+		}
+		closedir(dir);
+		return true;
+	}
+
+	void Run(Changed changed)
+	{
+		std::vector<Pending> pending;
+		alignas(inotify_event) char buffer[4096];
+		while (!stopping)
+		{
+			pollfd fds[2] = {{notify, POLLIN, 0}, {wake[0], POLLIN, 0}};
+			int ready = poll(fds, 2, pending.empty() ? -1 : WATCH_SETTLE_MS);
+			if (ready == 0)
+			{
+				// Quiet long enough; everything waiting is done being written
+				for (Pending const &file : pending)
+				{
+					changed(file.name, file.seen);
+				}
+				pending.clear();
+				continue;
+			}
+			if (ready < 0 || (fds[1].revents & POLLIN))
+			{
+				continue;
+			}
+
+			ssize_t got;
+			while ((got = read(notify, buffer, sizeof(buffer))) > 0)
+			{
+				auto now = std::chrono::steady_clock::now();
+				for (char *at = buffer; at < buffer + got;)
+				{
+					inotify_event const *event = reinterpret_cast<inotify_event const *>(at);
+					at += sizeof(inotify_event) + event->len;
+					if (event->len == 0 || event->wd >= static_cast<int>(directories.size()))
+					{
+						continue;
+					}
+
+					std::string name = directories[event->wd] + event->name;
+					if (event->mask & IN_ISDIR)
+					{
+						if (event->mask & (IN_CREATE | IN_MOVED_TO))
+						{
+							Watch(name + "/");
+						}
+						continue;
+					}
+					if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+					{
+						continue;
+					}
+
+					bool known = false;
+					for (Pending &file : pending)
+					{
+						if (file.name == name)
+						{
+							file.seen = now;
+							known = true;
+						}
+					}
+					if (!known)
+					{
+						pending.push_back(Pending{name, now});
+					}
+				}
+			}
+		}
+	}
+
+	std::string root;
+	std::vector<std::string> directories; // by watch descriptor, relative to root
+	int notify = -1;
+	int wake[2] = {-1, -1};
+#endif
+	std::thread thread;
+	std::atomic<bool> stopping{false};
+};